@@ -199,7 +199,8 @@ gboolean bookmark_fill_tag_completion(GtkListStore *store, const char *input)
 /**
  * Push a uri to the end of the queue.
  *
- * @uri: URI to put into the queue
+ * @uri: URI to put into the queue - several newline separated URIs are
+ *       written at once
  */
 gboolean bookmark_queue_push(const char *uri)
 {
@@ -209,7 +210,8 @@ gboolean bookmark_queue_push(const char *uri)
 /**
  * Push a uri to the bginning of the queue.
  *
- * @uri: URI to put into the queue
+ * @uri: URI to put into the queue - several newline separated URIs are
+ *       written at once
  */
 gboolean bookmark_queue_unshift(const char *uri)
 {
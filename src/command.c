@@ -26,23 +26,35 @@
 #include "command.h"
 #include "history.h"
 #include "bookmark.h"
+#include "search.js.h"
+
+#define SEARCH_FILE "search.js"
+#ifdef FEATURE_SEARCH_HIGHLIGHT
+#define SEARCH_HIGHLIGHT "true"
+#else
+#define SEARCH_HIGHLIGHT "false"
+#endif
 
 extern VbCore vb;
 
+/* the matches of the last search were marked by webkit */
+static gboolean search_marked = false;
+
+static void search(const char *query, int count, gboolean new);
+static void search_webkit(const char *query, int count);
+static void search_unmark(void);
+static void search_call(const char *call, gboolean inject);
+static char *js_string(const char *str);
+
 gboolean command_search(const Arg *arg)
 {
     static short dir;   /* last direction 1 forward, -1 backward*/
     static char *query = NULL;
-#ifdef FEATURE_SEARCH_HIGHLIGHT
-    static gboolean highlight = false;
-#endif
-    gboolean forward;
 
     if (arg->i == 0) {
-#ifdef FEATURE_SEARCH_HIGHLIGHT
-        webkit_web_view_unmark_text_matches(vb.gui.webview);
-        highlight = false;
-#endif
+        /* remove the highlights - the matches are kept for n and N */
+        search_call("clear()", false);
+        search_unmark();
         return true;
     }
 
@@ -53,33 +65,24 @@ gboolean command_search(const Arg *arg)
         dir = arg->i > 0 ? 1 : -1;
     }
 
-    forward = (arg->i * dir) > 0;
-
     if (query) {
-        unsigned int count = abs(arg->i);
-#ifdef FEATURE_SEARCH_HIGHLIGHT
-        if (!highlight) {
-            /* highlight matches if the search is started new or continued
-             * after switch to normal mode which calls this function with
-             * COMMAND_SEARCH_OFF */
-            webkit_web_view_mark_text_matches(vb.gui.webview, query, false, 0);
-            webkit_web_view_set_highlight_text_matches(vb.gui.webview, true);
-
-            /* mark the search as active */
-            highlight = true;
-        }
-#endif
-
-        do {
-            if (!webkit_web_view_search_text(vb.gui.webview, query, false, forward, true)) {
-                break;
-            }
-        } while (--count);
+        /* for n and N the count is relative to the search direction */
+        search(query, arg->s ? arg->i : arg->i * dir, arg->s != NULL);
     }
 
     return true;
 }
 
+/**
+ * Searches the query typed so far into the inputbox. A match at the
+ * selection is kept, so that the selection moves only if the typed chars
+ * don't match there anymore.
+ */
+void command_search_incremental(const char *query, gboolean forward)
+{
+    search(query, forward ? 1 : -1, true);
+}
+
 gboolean command_yank(const Arg *arg)
 {
     static char *tmpl = "Yanked: %s";
@@ -145,6 +148,109 @@ gboolean command_save(const Arg *arg)
     return true;
 }
 
+/**
+ * Selects the match count matches away in the direction of the sign of count.
+ * If new is true, the matches of the query are collected first, else they
+ * are only collected again if the query or the document changed. The
+ * collected matches allow to skip count matches without searching the page
+ * count times.
+ */
+static void search(const char *query, int count, gboolean new)
+{
+    char *js, *str;
+
+    search_unmark();
+
+    str = js_string(query);
+    js  = g_strdup_printf(
+        "%s(%s,%d," SEARCH_HIGHLIGHT ")", new ? "create" : "next", str, count
+    );
+    search_call(js, true);
+    g_free(js);
+    g_free(str);
+
+    /* the script finds only matches within a single text node of the main
+     * document - webkit finds also matches across elements and in frames */
+    if (!vb.state.search_count && *query) {
+        search_webkit(query, count);
+    }
+}
+
+static void search_webkit(const char *query, int count)
+{
+    gboolean forward = count > 0;
+    unsigned int n   = abs(count);
+
+#ifdef FEATURE_SEARCH_HIGHLIGHT
+    webkit_web_view_mark_text_matches(vb.gui.webview, query, false, 0);
+    webkit_web_view_set_highlight_text_matches(vb.gui.webview, true);
+#endif
+    search_marked = true;
+
+    do {
+        if (!webkit_web_view_search_text(vb.gui.webview, query, false, forward, true)) {
+            break;
+        }
+    } while (--n);
+}
+
+static void search_unmark(void)
+{
+    if (search_marked) {
+        webkit_web_view_unmark_text_matches(vb.gui.webview);
+        search_marked = false;
+    }
+}
+
+/**
+ * Calls given function of the search script and shows the match counter of
+ * its result in the statusbar. If inject is true, the script is injected
+ * into the page if this was not done yet.
+ */
+static void search_call(const char *call, gboolean inject)
+{
+    char *js, *value = NULL;
+    WebKitWebFrame *frame = webkit_web_view_get_main_frame(vb.gui.webview);
+
+    js = g_strconcat("window.VbSearch ? VbSearch.", call, " : null", NULL);
+    vb_eval_script(frame, js, SEARCH_FILE, &value);
+    if (inject && !g_strcmp0(value, "null")) {
+        g_free(value);
+        vb_eval_script(frame, SEARCH_JS, SEARCH_FILE, &value);
+        g_free(value);
+        vb_eval_script(frame, js, SEARCH_FILE, &value);
+    }
+    g_free(js);
+
+    if (!value || sscanf(value, "%u/%u", &vb.state.search_index, &vb.state.search_count) != 2) {
+        vb.state.search_index = vb.state.search_count = 0;
+    }
+    g_free(value);
+    vb_update_statusbar();
+}
+
+/**
+ * Retrieves given string as quoted javascript string literal. Returned
+ * string must be freed with g_free.
+ */
+static char *js_string(const char *str)
+{
+    GString *js = g_string_new("\"");
+
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            g_string_append_printf(js, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            g_string_append_printf(js, "\\u%04x", *str);
+        } else {
+            g_string_append_c(js, *str);
+        }
+    }
+    g_string_append_c(js, '"');
+
+    return g_string_free(js, false);
+}
+
 #ifdef FEATURE_QUEUE
 gboolean command_queue(const Arg *arg)
 {
@@ -41,6 +41,7 @@ enum {
 #endif
 
 gboolean command_search(const Arg *arg);
+void command_search_incremental(const char *query, gboolean forward);
 gboolean command_yank(const Arg *arg);
 gboolean command_save(const Arg *arg);
 #ifdef FEATURE_QUEUE
@@ -36,6 +36,10 @@
 #define FEATURE_TITLE_PROGRESS
 /* should the history indicator [+-] be shown in status bar after url */
 #define FEATURE_HISTORY_INDICATOR
+/* measure the latency of the key handling - results are shown by :keystats */
+/* #define FEATURE_KEYSTATS */
+/* index the text of visited pages for the :open ?query completion */
+/* #define FEATURE_FULLTEXT */
 
 
 /* time in seconds after that message will be removed from inputbox if the
@@ -49,6 +53,30 @@
 #define SETTING_MAX_CONNS_PER_HOST   5
 
 #define MAXIMUM_HINTS              500
+/* time in milliseconds between the windows opened for the hints collected
+ * in rapid hint mode */
+#define RAPID_HINT_OPEN_DELAY      250
+
+/* bounds of the delay in milliseconds after the last typed char before the
+ * incremental search is run - the delay adapts to the duration of the last
+ * search within these bounds */
+#define INCSEARCH_DELAY_MIN         50
+#define INCSEARCH_DELAY_MAX        500
+
+/* maximum number of bytes of the text of a page that are indexed */
+#define FULLTEXT_MAX_TEXT        65536
+/* size in bytes the log of newly indexed pages may grow to before it's
+ * merged into the index file */
+#define FULLTEXT_LOG_MAX       1048576
+/* maximum number of pages shown in the full-text completion */
+#define FULLTEXT_MAX_RESULTS       100
+
+/* time in milliseconds between two applications of collected scroll
+ * distances if the frame clock of gtk+3 is not available */
+#define SCROLL_FRAME_TIME           16
+/* fraction of the remaining scroll distance that is applied per frame if
+ * smooth-scroll is enabled */
+#define SMOOTH_SCROLL_STEP         0.3
 
 #define WIN_WIDTH                  800
 #define WIN_HEIGHT                 600
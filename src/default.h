@@ -37,6 +37,7 @@ static char *default_config[] = {
     "set strict-ssl=on",
     "set strict-focus=off",
     "set scrollstep=40",
+    "set smooth-scroll=off",
     "set status-color-bg=#000",
     "set status-color-fg=#fff",
     "set status-font=monospace bold 8",
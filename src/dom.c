@@ -24,7 +24,17 @@
 
 extern VbCore vb;
 
+/* index of the inputs and textareas of the main document */
+static struct {
+    Document  *doc;         /* document the index was built for */
+    GPtrArray *elements;    /* the input and textarea elements in document order */
+} editables;
+
 static gboolean element_is_visible(WebKitDOMDOMWindow* win, WebKitDOMElement* element);
+static void index_build(Document *doc);
+static void index_clear(void);
+static gboolean is_text_input(Element *element);
+static gboolean node_changed_cb(Element *element, Event *event);
 static gboolean auto_insert(Element *element);
 static gboolean editable_focus_cb(Element *element, Event *event);
 static Element *get_active_element(Document *doc);
@@ -69,44 +79,36 @@ void dom_clear_focus(WebKitWebView *view)
  */
 gboolean dom_focus_input(WebKitWebView *view)
 {
-    gboolean found = false;
-    WebKitDOMNode *html, *node;
-    WebKitDOMDocument *doc;
+    Element *element;
     WebKitDOMDOMWindow *win;
-    WebKitDOMNodeList *list;
-    WebKitDOMXPathNSResolver *resolver;
-    WebKitDOMXPathResult* result;
-
-    doc  = webkit_web_view_get_dom_document(view);
-    win  = webkit_dom_document_get_default_view(doc);
-    list = webkit_dom_document_get_elements_by_tag_name(doc, "html");
-    if (!list) {
-        return false;
-    }
+    Document *doc = webkit_web_view_get_dom_document(view);
 
-    html     = webkit_dom_node_list_item(list, 0);
-    resolver = webkit_dom_document_create_ns_resolver(doc, html);
-    if (!resolver) {
-        return false;
+    /* the index is built on first use for the document and dropped on the
+     * next change of the document structure */
+    if (doc != editables.doc) {
+        index_build(doc);
     }
 
-    result = webkit_dom_document_evaluate(
-        doc, "//input[not(@type) or @type='text' or @type='password']|//textarea",
-        html, resolver, 0, NULL, NULL
-    );
-    if (!result) {
-        return false;
-    }
-    while ((node = webkit_dom_xpath_result_iterate_next(result, NULL))) {
-        if (element_is_visible(win, WEBKIT_DOM_ELEMENT(node))) {
-            webkit_dom_element_focus(WEBKIT_DOM_ELEMENT(node));
-            found = true;
-            break;
+    win = webkit_dom_document_get_default_view(doc);
+    for (guint i = 0; i < editables.elements->len; i++) {
+        element = g_ptr_array_index(editables.elements, i);
+        /* the type of an input may have changed since the index was built */
+        if (is_text_input(element) && element_is_visible(win, element)) {
+            webkit_dom_element_focus(element);
+            return true;
         }
     }
-    g_object_unref(list);
 
-    return found;
+    return false;
+}
+
+/**
+ * Drops the index of the editable elements and stops listening to the changes
+ * of its document. Called when the document is left.
+ */
+void dom_clear_index(void)
+{
+    index_clear();
 }
 
 /**
@@ -196,6 +198,92 @@ static gboolean element_is_visible(WebKitDOMDOMWindow* win, WebKitDOMElement* el
     return true;
 }
 
+/**
+ * Collects the input and textarea elements of given document, so that they
+ * don't need to be searched in the whole document on each gi. The index is
+ * dropped together with the mutation listeners as soon as elements are
+ * inserted into or removed from the document.
+ */
+static void index_build(Document *doc)
+{
+    WebKitDOMNodeList *list;
+
+    index_clear();
+    /* keep the document so that another one can't get the same address */
+    editables.doc      = g_object_ref(doc);
+    editables.elements = g_ptr_array_new_with_free_func(g_object_unref);
+
+    list = webkit_dom_document_query_selector_all(doc, "input, textarea", NULL);
+    if (list) {
+        for (gulong i = 0; i < webkit_dom_node_list_get_length(list); i++) {
+            g_ptr_array_add(editables.elements, g_object_ref(webkit_dom_node_list_item(list, i)));
+        }
+        g_object_unref(list);
+    }
+
+    webkit_dom_event_target_add_event_listener(
+        WEBKIT_DOM_EVENT_TARGET(doc), "DOMNodeInserted", G_CALLBACK(node_changed_cb), false, NULL
+    );
+    webkit_dom_event_target_add_event_listener(
+        WEBKIT_DOM_EVENT_TARGET(doc), "DOMNodeRemoved", G_CALLBACK(node_changed_cb), false, NULL
+    );
+}
+
+static void index_clear(void)
+{
+    if (!editables.doc) {
+        return;
+    }
+    webkit_dom_event_target_remove_event_listener(
+        WEBKIT_DOM_EVENT_TARGET(editables.doc), "DOMNodeInserted", G_CALLBACK(node_changed_cb), false
+    );
+    webkit_dom_event_target_remove_event_listener(
+        WEBKIT_DOM_EVENT_TARGET(editables.doc), "DOMNodeRemoved", G_CALLBACK(node_changed_cb), false
+    );
+    g_object_unref(editables.doc);
+    g_ptr_array_free(editables.elements, true);
+    editables.doc      = NULL;
+    editables.elements = NULL;
+}
+
+/**
+ * Indicates if the element is a text input or textarea that can be focused
+ * by gi.
+ */
+static gboolean is_text_input(Element *element)
+{
+    gboolean result = false;
+    char *tagname, *type;
+
+    tagname = webkit_dom_element_get_tag_name(element);
+    if (!g_ascii_strcasecmp(tagname, "textarea")) {
+        result = true;
+    } else if (!g_ascii_strcasecmp(tagname, "input")) {
+        type   = webkit_dom_element_get_attribute(element, "type");
+        result = !type || !*type
+            || !g_ascii_strcasecmp(type, "text")
+            || !g_ascii_strcasecmp(type, "password");
+        g_free(type);
+    }
+    g_free(tagname);
+
+    return result;
+}
+
+/**
+ * Drops the index on the first structural change of the document, the next
+ * gi builds it again. So the listeners don't slow down pages that change
+ * their document often.
+ */
+static gboolean node_changed_cb(Element *element, Event *event)
+{
+    /* inserted or removed text nodes can't contain any indexed element */
+    if (WEBKIT_DOM_IS_ELEMENT(webkit_dom_event_get_target(event))) {
+        index_clear();
+    }
+    return false;
+}
+
 static gboolean auto_insert(Element *element)
 {
     if (dom_is_editable(element)) {
@@ -22,6 +22,8 @@
  * commands from inputbox and the ex commands.
  */
 #include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
 #include <sys/wait.h>
 #include "config.h"
 #include "main.h"
@@ -38,6 +40,8 @@
 #include "bookmark.h"
 #include "shortcut.h"
 #include "map.h"
+#include "keystats.h"
+#include "fulltext.h"
 
 typedef enum {
     EX_BMA,
@@ -52,6 +56,9 @@ typedef enum {
     EX_CUNMAP,
     EX_IUNMAP,
     EX_INOREMAP,
+#ifdef FEATURE_KEYSTATS
+    EX_KEYSTATS,
+#endif
     EX_NUNMAP,
     EX_NORMAL,
     EX_OPEN,
@@ -111,6 +118,9 @@ static gboolean execute(const ExArg *arg);
 static gboolean ex_bookmark(const ExArg *arg);
 static gboolean ex_eval(const ExArg *arg);
 static gboolean ex_hardcopy(const ExArg *arg);
+#ifdef FEATURE_KEYSTATS
+static gboolean ex_keystats(const ExArg *arg);
+#endif
 static gboolean ex_map(const ExArg *arg);
 static gboolean ex_unmap(const ExArg *arg);
 static gboolean ex_normal(const ExArg *arg);
@@ -124,10 +134,18 @@ static gboolean ex_set(const ExArg *arg);
 static gboolean ex_shellcmd(const ExArg *arg);
 static gboolean ex_shortcut(const ExArg *arg);
 
+static void shell_setup(gpointer data);
+static gboolean shell_read(GIOChannel *channel, GIOCondition cond, gpointer data);
+static void shell_exited(GPid pid, int status, gpointer data);
+static void shell_finish(void);
+
 static gboolean complete(short direction);
 static void completion_select(char *match);
 static gboolean history(gboolean prev);
 static void history_rewind(void);
+static void incsearch_start(const char *query, gboolean forward);
+static void incsearch_stop(void);
+static gboolean incsearch_run(gpointer data);
 
 /* The order of following command names is significant. If there exists
  * ambiguous commands matching to the users input, the first defined will be
@@ -147,6 +165,9 @@ static ExInfo commands[] = {
     {"imap",             EX_IMAP,        ex_map,        EX_FLAG_LHS|EX_FLAG_RHS},
     {"inoremap",         EX_INOREMAP,    ex_map,        EX_FLAG_LHS|EX_FLAG_RHS},
     {"iunmap",           EX_IUNMAP,      ex_unmap,      EX_FLAG_LHS},
+#ifdef FEATURE_KEYSTATS
+    {"keystats",         EX_KEYSTATS,    ex_keystats,   EX_FLAG_RHS|EX_FLAG_EXP},
+#endif
     {"nmap",             EX_NMAP,        ex_map,        EX_FLAG_LHS|EX_FLAG_RHS},
     {"nnoremap",         EX_NNOREMAP,    ex_map,        EX_FLAG_LHS|EX_FLAG_RHS},
     {"normal",           EX_NORMAL,      ex_normal,     EX_FLAG_BANG|EX_FLAG_LHS},
@@ -180,6 +201,24 @@ static struct {
     GList *active;
 } exhist;
 
+/* running command started by :shellcmd */
+static struct {
+    GPid    pid;
+    GString *out[2];  /* collected output of stdout and stderr */
+    guint   watch[2]; /* io watch sources of stdout and stderr pipe */
+    gsize   line;     /* offset of the last line of stdout shown while running */
+    int     status;   /* exit status of the command */
+    gboolean exited;  /* the command has exited but the pipes may still have data */
+} shell;
+
+/* pending incremental search */
+static struct {
+    guint    timer;    /* source of the delayed search */
+    char     *query;
+    gboolean forward;
+    guint    delay;    /* current delay in milliseconds */
+} incsearch;
+
 extern VbCore vb;
 
 
@@ -199,6 +238,17 @@ void ex_leave(void)
 {
     completion_clean();
     hints_clear();
+    incsearch_stop();
+}
+
+/**
+ * Drops the pending incremental search and kills a running shell command on
+ * quit.
+ */
+void ex_cleanup(void)
+{
+    incsearch_stop();
+    ex_shellcmd_cancel();
 }
 
 /**
@@ -322,8 +372,7 @@ void ex_input_changed(const char *text)
 
         case '/': forward = true; /* fall through */
         case '?':
-            webkit_web_view_unmark_text_matches(vb.gui.webview);
-            webkit_web_view_search_text(vb.gui.webview, &text[1], false, forward, false);
+            incsearch_start(&text[1], forward);
             break;
     }
 }
@@ -373,6 +422,8 @@ static void input_activate(void)
     switch (*text) {
         case '/': count = 1; /* fall throught */
         case '?':
+            /* the search is done right now, so drop the pending one */
+            incsearch_stop();
             history_add(HISTORY_SEARCH, cmd, NULL);
             mode_enter('n');
             command_search(&((Arg){count, cmd}));
@@ -394,19 +445,89 @@ static void input_activate(void)
 
 gboolean ex_run_string(const char *input)
 {
+    const char *start;
+    guint mark;
+    gboolean success = true, batch = false;
     ExArg *arg = g_new0(ExArg, 1);
     arg->lhs   = g_string_new("");
     arg->rhs   = g_string_new("");
 
     while (input && *input) {
-        if (!parse(&input, arg) || !execute(arg)) {
-            free_cmdarg(arg);
-            return false;
+        start = input;
+        mark  = setting_cache_mark();
+        if (!parse(&input, arg)) {
+            success = false;
+            break;
+        }
+        /* apply the webkit settings of a line with several commands at
+         * once - a single setting is applied directly, which is cheaper */
+        if (!batch && *input) {
+            setting_transaction_begin();
+            batch = true;
         }
+        if (!execute(arg)) {
+            success = false;
+            break;
+        }
+        /* settings are recorded in compiled form for the config cache, all
+         * other commands have to be recorded as they are */
+        if (arg->code != EX_SET) {
+            setting_cache_add_command(mark, start, input - start);
+        }
+    }
+    if (batch) {
+        setting_transaction_commit();
     }
     free_cmdarg(arg);
 
-    return true;
+    return success;
+}
+
+/**
+ * Schedules the incremental search for given query. The search is delayed
+ * until the typing pauses, so that no search is run for each typed char.
+ * The delay grows with the time the last search took, so that large
+ * documents are not searched more often than the browser can handle.
+ */
+static void incsearch_start(const char *query, gboolean forward)
+{
+    OVERWRITE_STRING(incsearch.query, query);
+    incsearch.forward = forward;
+
+    /* a newer input replaces the pending search */
+    if (incsearch.timer) {
+        g_source_remove(incsearch.timer);
+    }
+    if (!incsearch.delay) {
+        incsearch.delay = INCSEARCH_DELAY_MIN;
+    }
+    incsearch.timer = g_timeout_add(incsearch.delay, incsearch_run, NULL);
+}
+
+static void incsearch_stop(void)
+{
+    if (incsearch.timer) {
+        g_source_remove(incsearch.timer);
+        incsearch.timer = 0;
+    }
+    g_free(incsearch.query);
+    incsearch.query = NULL;
+}
+
+static gboolean incsearch_run(gpointer data)
+{
+    gint64 start = g_get_monotonic_time();
+    guint took;
+
+    incsearch.timer = 0;
+
+    command_search_incremental(incsearch.query, incsearch.forward);
+
+    /* wait at least twice the time of the search for the next one */
+    took            = (g_get_monotonic_time() - start) / 1000;
+    incsearch.delay = CLAMP(2 * took, INCSEARCH_DELAY_MIN, INCSEARCH_DELAY_MAX);
+
+    return false;
 }
 
 /**
@@ -711,6 +832,34 @@ static gboolean ex_hardcopy(const ExArg *arg)
     return true;
 }
 
+#ifdef FEATURE_KEYSTATS
+static gboolean ex_keystats(const ExArg *arg)
+{
+    char *text, *file;
+    gboolean success;
+
+    /* without file show the percentiles in the inputbox */
+    if (!*arg->rhs->str) {
+        text = keystats_summary();
+        vb_echo(VB_MSG_NORMAL, false, "%s", text);
+        g_free(text);
+
+        return true;
+    }
+
+    file    = util_build_path(arg->rhs->str, NULL);
+    success = keystats_write(file);
+    if (success) {
+        vb_echo(VB_MSG_NORMAL, true, "Key stats written to %s", file);
+    } else {
+        vb_echo(VB_MSG_ERROR, true, "Could not write key stats to %s", file);
+    }
+    g_free(file);
+
+    return success;
+}
+#endif
+
 static gboolean ex_map(const ExArg *arg)
 {
     if (!arg->lhs->len || !arg->rhs->len) {
@@ -829,10 +978,38 @@ static gboolean ex_set(const ExArg *arg)
     return success;
 }
 
+/**
+ * Kills the running command started by :shellcmd if there is one.
+ * Returns true if a command was killed.
+ */
+gboolean ex_shellcmd_cancel(void)
+{
+    if (!shell.pid) {
+        return false;
+    }
+
+    /* kill the whole process group to get also the children of the shell */
+    kill(-shell.pid, SIGTERM);
+    for (int i = 0; i < 2; i++) {
+        if (shell.watch[i]) {
+            g_source_remove(shell.watch[i]);
+            shell.watch[i] = 0;
+        }
+        g_string_free(shell.out[i], true);
+        shell.out[i] = NULL;
+    }
+    /* the child watch stays to reap the killed process */
+    shell.pid = 0;
+
+    return true;
+}
+
 static gboolean ex_shellcmd(const ExArg *arg)
 {
-    int status, argc;
-    char *cmd, *error = NULL, *out = NULL, **argv;
+    int argc, fd[2];
+    char *cmd, **argv;
+    GError *error = NULL;
+    GIOChannel *channel;
 
     if (!*arg->rhs->str) {
         return false;
@@ -847,15 +1024,40 @@ static gboolean ex_shellcmd(const ExArg *arg)
     }
     g_free(cmd);
 
-    g_spawn_sync(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &out, &error, &status, NULL);
+    /* there is only one command running at the same time */
+    ex_shellcmd_cancel();
+
+    if (!g_spawn_async_with_pipes(
+        NULL, argv, NULL, G_SPAWN_SEARCH_PATH|G_SPAWN_DO_NOT_REAP_CHILD,
+        shell_setup, NULL, &shell.pid, NULL, &fd[0], &fd[1], &error
+    )) {
+        vb_echo(VB_MSG_ERROR, true, "Could not run command: %s", error->message);
+        g_error_free(error);
+        g_strfreev(argv);
+        shell.pid = 0;
+
+        return false;
+    }
     g_strfreev(argv);
-    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-        vb_echo(VB_MSG_NORMAL, true, "%s", out);
-        return true;
+
+    shell.exited = false;
+    shell.line   = 0;
+    for (int i = 0; i < 2; i++) {
+        shell.out[i] = g_string_new("");
+        channel      = g_io_channel_unix_new(fd[i]);
+        g_io_channel_set_encoding(channel, NULL, NULL);
+        g_io_channel_set_flags(channel, G_IO_FLAG_NONBLOCK, NULL);
+        g_io_channel_set_close_on_unref(channel, true);
+
+        /* the watch holds the reference to the channel */
+        shell.watch[i] = g_io_add_watch(
+            channel, G_IO_IN|G_IO_HUP|G_IO_ERR, shell_read, GINT_TO_POINTER(i)
+        );
+        g_io_channel_unref(channel);
     }
+    g_child_watch_add(shell.pid, shell_exited, GINT_TO_POINTER(shell.pid));
 
-    vb_echo(VB_MSG_ERROR, true, "[%d] %s", WEXITSTATUS(status), error);
-    return false;
+    return true;
 }
 
 static gboolean ex_shortcut(const ExArg *arg)
@@ -883,6 +1085,99 @@ static gboolean ex_shortcut(const ExArg *arg)
     }
 }
 
+/**
+ * Runs in the child before the command is executed to put the command into
+ * its own process group, so it can be killed with all its children.
+ */
+static void shell_setup(gpointer data)
+{
+    setpgid(0, 0);
+}
+
+/**
+ * Collects the output of the running shell command and shows the last line of
+ * the stdout as it arrives.
+ */
+static gboolean shell_read(GIOChannel *channel, GIOCondition cond, gpointer data)
+{
+    char buf[BUF_SIZE];
+    gsize len, size;
+    GIOStatus status;
+    GString *out;
+    int i = GPOINTER_TO_INT(data);
+
+    size = shell.out[i]->len;
+    do {
+        status = g_io_channel_read_chars(channel, buf, sizeof(buf), &len, NULL);
+        if (len) {
+            g_string_append_len(shell.out[i], buf, len);
+        }
+    } while (status == G_IO_STATUS_NORMAL && len == sizeof(buf));
+
+    out = shell.out[i];
+    if (i == 0 && out->len > size) {
+        /* look only at the new data for the start of the last line, showing
+         * all the output collected so far on each read gets slow for
+         * commands with much output */
+        for (gsize j = MAX(size, 1); j < out->len; j++) {
+            if (out->str[j - 1] == '\n') {
+                shell.line = j;
+            }
+        }
+        len = out->len - shell.line;
+        if (len && out->str[out->len - 1] == '\n') {
+            len--;
+        }
+        vb_echo(VB_MSG_NORMAL, false, "%.*s", (int)len, out->str + shell.line);
+    }
+
+    if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN) {
+        return true;
+    }
+
+    /* pipe was closed */
+    shell.watch[i] = 0;
+    shell_finish();
+
+    return false;
+}
+
+static void shell_exited(GPid pid, int status, gpointer data)
+{
+    g_spawn_close_pid(pid);
+
+    /* ignore commands that where killed or replaced by a new one */
+    if (shell.pid != GPOINTER_TO_INT(data)) {
+        return;
+    }
+    shell.status = status;
+    shell.exited = true;
+    shell_finish();
+}
+
+/**
+ * Prints the result of the shell command after the command exited and all
+ * its output was read.
+ */
+static void shell_finish(void)
+{
+    if (!shell.exited || shell.watch[0] || shell.watch[1]) {
+        return;
+    }
+
+    if (WIFEXITED(shell.status) && WEXITSTATUS(shell.status) == 0) {
+        vb_echo(VB_MSG_NORMAL, true, "%s", shell.out[0]->str);
+    } else {
+        vb_echo(VB_MSG_ERROR, true, "[%d] %s", WEXITSTATUS(shell.status), shell.out[1]->str);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        g_string_free(shell.out[i], true);
+        shell.out[i] = NULL;
+    }
+    shell.pid = 0;
+}
+
 /**
  * Manage the generation and stepping through completions.
  * This function prepared some prefix and suffix string that are required to
@@ -946,6 +1241,10 @@ static gboolean complete(short direction)
                 case EX_TABOPEN:
                     if (*in == '!') {
                         found = bookmark_fill_completion(store, in + 1);
+#ifdef FEATURE_FULLTEXT
+                    } else if (*in == '?') {
+                        found = fulltext_fill_completion(store, in + 1);
+#endif
                     } else {
                         found = history_fill_completion(store, HISTORY_URL, in);
                     }
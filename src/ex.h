@@ -25,9 +25,11 @@
 
 void ex_enter(void);
 void ex_leave(void);
+void ex_cleanup(void);
 VbResult ex_keypress(int key);
 void ex_input_changed(const char *text);
 gboolean ex_fill_completion(GtkListStore *store, const char *input);
 gboolean ex_run_string(const char *input);
+gboolean ex_shellcmd_cancel(void);
 
 #endif /* end of include guard: _EX_H */
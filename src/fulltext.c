@@ -0,0 +1,1105 @@
+/**
+ * vimb - a webkit based vim like browser.
+ *
+ * Copyright (C) 2012-2013 Daniel Carl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+/**
+ * Full-text index of the visited pages. The text of the loaded pages is
+ * tokenized and added by a worker thread to an inverted index that maps each
+ * term to the ids of the pages containing it. The ids are stored as varint
+ * encoded gaps, so that the index is compact and the lists can be
+ * intersected by a single pass. A page is added again on each visit with a
+ * new id, so that the ids follow the order of the latest visits and changed
+ * text is taken. The older ids of the page are skipped by the completion and
+ * dropped on the next merge.
+ *
+ * New pages are appended to a log file, which is merged into the binary
+ * index file once it gets too large. Both files are guarded by a lock on the
+ * log, so that several instances can share them. The lock is only released
+ * if the last descriptor of the log is closed, so the log is always accessed
+ * through the single descriptor of the worker.
+ *
+ * Only the pages of the log are held in memory. The index file is mapped
+ * and its terms are sorted, so that a lookup reads only the few records it
+ * needs and the pages of the file are shared by all instances. The file
+ * starts with the MAGIC followed by the doc records (uri, title) and the term
+ * records (term, count, postings). It ends with the offsets of the doc
+ * records by id, the offsets of the term records in sort order of the terms
+ * and the number of docs and terms, all as 32 bit little endian values.
+ */
+#include <unistd.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "main.h"
+#include "fulltext.h"
+#include "completion.h"
+
+#ifdef FEATURE_FULLTEXT
+
+#define MAGIC      "VBFT2"
+#define TERM_MIN   2        /* minimum bytes of an indexed term */
+#define TERM_MAX   32       /* maximum bytes of an indexed term */
+#define WRITE_SIZE 65536    /* bytes collected before the index file is written */
+
+typedef struct {
+    char *uri;
+    char *title;
+} Doc;
+
+typedef struct {
+    GByteArray *data;       /* varint encoded gaps between the doc ids */
+    guint      count;       /* number of docs containing the term */
+    guint      last;        /* last added doc id */
+} Postings;
+
+typedef struct {
+    GMappedFile  *map;          /* index file, NULL if there is none */
+    const guchar *doc_table;    /* offsets of the doc records by doc id */
+    const guchar *term_table;   /* offsets of the term records by term */
+    guint        base;          /* number of docs in the file */
+    guint        nterms;        /* number of terms in the file */
+    GPtrArray    *docs;         /* Doc of the log pages by doc id - base */
+    GHashTable   *uris;         /* uri of the log pages to latest doc id + 1 */
+    GHashTable   *terms;        /* term of the log pages to Postings */
+} Index;
+
+/* page to be indexed by the worker - a job without uri stops the worker */
+typedef struct {
+    char  *uri;
+    char  *title;
+    char  *text;
+    guint max;              /* number of pages the index may hold */
+} Job;
+
+/* cursor to parse the binary index file */
+typedef struct {
+    const guchar *pos;
+    const guchar *end;
+    gboolean     error;
+} Reader;
+
+static struct {
+    GThread     *thread;
+    GAsyncQueue *jobs;
+    GMutex      lock;       /* guards the index that is replaced by the worker */
+    Index       *index;     /* NULL until the worker has loaded it */
+} fulltext;
+
+extern VbCore vb;
+
+static char *get_text(WebKitDOMNode *root);
+static gpointer worker(gpointer data);
+static void index_page(Index *index, Job *job, int fd);
+static Index *merge(int fd, guint max);
+static Index *load(int fd);
+static char *read_log(int fd);
+static Index *index_new(void);
+static void index_free(Index *index);
+static gboolean index_map(Index *index, const char *file);
+static void index_add(Index *index, const char *uri, const char *title, char **terms);
+static void index_replay(Index *index, const char *log);
+static GArray *index_lookup(Index *index, const char *term);
+static gboolean index_get_doc(Index *index, guint id, char **uri, char **title);
+static gboolean index_is_latest(Index *index, guint id, const char *uri);
+static guint index_cut(Index *index, guint max);
+static gboolean index_write(Index *index, const char *file, guint max);
+static gboolean file_record(Index *index, const guchar *table, guint i, Reader *r);
+static char *file_term(Index *index, guint i, Reader *r);
+static gboolean file_find(Index *index, const char *term, Reader *r);
+static gboolean file_postings(Index *index, Reader *r, GArray *ids);
+static void postings_append(Postings *p, GArray *ids);
+static void intersect(GArray *ids, GArray *other);
+static void put_term(GByteArray *buf, const char *term, GArray *list, const guint *ids);
+static gboolean flush(int fd, GByteArray *buf, gsize *pos, gboolean force);
+static gint compare_terms(gconstpointer a, gconstpointer b);
+static char **tokenize(const char *text, const char *more);
+static void lock_file(int fd, short type);
+static void put_varint(GByteArray *buf, guint value);
+static void put_string(GByteArray *buf, const char *str);
+static void put_uint32(GByteArray *buf, guint32 value);
+static guint get_varint(Reader *r);
+static char *get_string(Reader *r);
+static guint32 get_uint32(const guchar *data);
+static void free_doc(Doc *doc);
+static void free_postings(Postings *p);
+static void free_job(Job *job);
+
+void fulltext_init(void)
+{
+    g_mutex_init(&fulltext.lock);
+    fulltext.jobs   = g_async_queue_new_full((GDestroyNotify)free_job);
+    fulltext.thread = g_thread_new("fulltext", worker, NULL);
+}
+
+/**
+ * Waits for the worker to index the pending pages and frees the index.
+ */
+void fulltext_cleanup(void)
+{
+    if (!fulltext.thread) {
+        return;
+    }
+    g_async_queue_push(fulltext.jobs, g_new0(Job, 1));
+    g_thread_join(fulltext.thread);
+    fulltext.thread = NULL;
+
+    g_async_queue_unref(fulltext.jobs);
+    index_free(fulltext.index);
+    fulltext.index = NULL;
+    g_mutex_clear(&fulltext.lock);
+}
+
+/**
+ * Queues the text of the page in given view to be indexed. Only the text is
+ * taken here, all the work is done by the worker thread.
+ */
+void fulltext_add(WebKitWebView *view)
+{
+    Job *job;
+    const char *title, *uri = webkit_web_view_get_uri(view);
+    WebKitDOMHTMLElement *body;
+
+    /* the index is limited like the history */
+    if (!vb.config.history_max || !uri) {
+        return;
+    }
+
+    body = webkit_dom_document_get_body(webkit_web_view_get_dom_document(view));
+    if (!body) {
+        return;
+    }
+    title = webkit_web_view_get_title(view);
+
+    job        = g_new0(Job, 1);
+    job->uri   = g_strdup(uri);
+    job->title = g_strdelimit(g_strdup(title ? title : ""), "\t\r\n", ' ');
+    job->text  = get_text(WEBKIT_DOM_NODE(body));
+    job->max   = vb.config.history_max;
+
+    g_async_queue_push(fulltext.jobs, job);
+}
+
+/**
+ * Fills the store with the pages that contain all the words of input, the
+ * latest visited first.
+ */
+gboolean fulltext_fill_completion(GtkListStore *store, const char *input)
+{
+    char **terms, *uri, *title;
+    guint n, id, cut, i, num = 0;
+    GArray *ids = NULL, *other;
+    Index *index;
+    GtkTreeIter iter;
+
+    terms = tokenize(input, NULL);
+    n     = g_strv_length(terms);
+    if (!n) {
+        g_strfreev(terms);
+        return false;
+    }
+
+    g_mutex_lock(&fulltext.lock);
+    if (!(index = fulltext.index)) {
+        goto out;
+    }
+
+    ids = index_lookup(index, terms[0]);
+    for (i = 1; i < n && ids->len; i++) {
+        other = index_lookup(index, terms[i]);
+        intersect(ids, other);
+        g_array_free(other, true);
+    }
+
+    cut = ids->len ? index_cut(index, vb.config.history_max) : 0;
+    for (i = ids->len; i > 0 && num < FULLTEXT_MAX_RESULTS; i--) {
+        id = g_array_index(ids, guint, i - 1);
+        if (id < cut) {
+            break;
+        }
+        if (!index_get_doc(index, id, &uri, &title)) {
+            continue;
+        }
+        /* skip the pages that were visited again later */
+        if (index_is_latest(index, id, uri)) {
+            gtk_list_store_append(store, &iter);
+            gtk_list_store_set(
+                store, &iter,
+                COMPLETION_STORE_FIRST, uri,
+#ifdef FEATURE_TITLE_IN_COMPLETION
+                COMPLETION_STORE_SECOND, title,
+#endif
+                -1
+            );
+            num++;
+        }
+        g_free(uri);
+        g_free(title);
+    }
+
+out:
+    g_mutex_unlock(&fulltext.lock);
+    if (ids) {
+        g_array_free(ids, true);
+    }
+    g_strfreev(terms);
+
+    return num > 0;
+}
+
+/**
+ * Retrieves the text of the text nodes below root up to FULLTEXT_MAX_TEXT
+ * bytes. Unlike innerText this needs no layout of the page and stops once
+ * enough text is collected.
+ *
+ * Returned string must be freed with g_free.
+ */
+static char *get_text(WebKitDOMNode *root)
+{
+    char *value;
+    gboolean skip;
+    WebKitDOMNode *node = root, *next;
+    GString *text       = g_string_new("");
+
+    while (node && text->len < FULLTEXT_MAX_TEXT) {
+        switch (webkit_dom_node_get_node_type(node)) {
+            case WEBKIT_DOM_NODE_TEXT_NODE:
+                value = webkit_dom_node_get_text_content(node);
+                g_string_append(text, value);
+                g_string_append_c(text, ' ');
+                g_free(value);
+                break;
+
+            case WEBKIT_DOM_NODE_ELEMENT_NODE:
+                value = webkit_dom_node_get_node_name(node);
+                skip  = !g_ascii_strcasecmp(value, "script")
+                    || !g_ascii_strcasecmp(value, "style")
+                    || !g_ascii_strcasecmp(value, "noscript");
+                g_free(value);
+                if (!skip && (next = webkit_dom_node_get_first_child(node))) {
+                    node = next;
+                    continue;
+                }
+                break;
+        }
+        /* continue with the next sibling of the node or its ancestors */
+        while (node != root && !(next = webkit_dom_node_get_next_sibling(node))) {
+            node = webkit_dom_node_get_parent_node(node);
+        }
+        node = node == root ? NULL : next;
+    }
+    /* the text could be cut within a char, which the tokenizer stops at */
+    if (text->len > FULLTEXT_MAX_TEXT) {
+        g_string_truncate(text, FULLTEXT_MAX_TEXT);
+    }
+
+    return g_string_free(text, false);
+}
+
+static gpointer worker(gpointer data)
+{
+    Job *job;
+    Index *index;
+    struct stat st;
+    /* without the log file the pages are only indexed in memory */
+    int fd = open(vb.files[FILES_FULLTEXT_LOG], O_RDWR|O_APPEND|O_CREAT, 0600);
+
+    if (fd != -1) {
+        lock_file(fd, F_RDLCK);
+    }
+    index = load(fd);
+    if (fd != -1) {
+        lock_file(fd, F_UNLCK);
+    }
+    g_mutex_lock(&fulltext.lock);
+    fulltext.index = index;
+    g_mutex_unlock(&fulltext.lock);
+
+    while ((job = g_async_queue_pop(fulltext.jobs))->uri) {
+        index_page(index, job, fd);
+
+        /* merge the log into the index file if it gets too large */
+        if (fd != -1 && !fstat(fd, &st) && st.st_size > FULLTEXT_LOG_MAX) {
+            index = merge(fd, job->max);
+            g_mutex_lock(&fulltext.lock);
+            index_free(fulltext.index);
+            fulltext.index = index;
+            g_mutex_unlock(&fulltext.lock);
+        }
+        free_job(job);
+    }
+    free_job(job);
+    if (fd != -1) {
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/**
+ * Writes the terms of the page to the log given by fd and adds them to the
+ * index.
+ */
+static void index_page(Index *index, Job *job, int fd)
+{
+    char **terms, *line, *list;
+
+    terms = tokenize(job->text, job->title);
+    list  = g_strjoinv(" ", terms);
+    line  = g_strconcat(job->uri, "\t", job->title, "\t", list, "\n", NULL);
+
+    if (fd != -1) {
+        lock_file(fd, F_WRLCK);
+        if (write(fd, line, strlen(line)) == -1) {
+            g_warning("Could not write %s", vb.files[FILES_FULLTEXT_LOG]);
+        }
+        lock_file(fd, F_UNLCK);
+    }
+
+    g_mutex_lock(&fulltext.lock);
+    index_add(index, job->uri, job->title, terms);
+    g_mutex_unlock(&fulltext.lock);
+
+    g_free(line);
+    g_free(list);
+    g_strfreev(terms);
+}
+
+/**
+ * Merges the log given by fd into the index file and empties the log. The
+ * files are read again to include the pages added by other instances. Only
+ * the latest max pages are kept, each with the id of its latest visit.
+ *
+ * Returns the merged index.
+ */
+static Index *merge(int fd, guint max)
+{
+    Index *index;
+
+    lock_file(fd, F_WRLCK);
+    index = load(fd);
+    if (index_write(index, vb.files[FILES_FULLTEXT], max)) {
+        if (ftruncate(fd, 0) == -1) {
+            g_warning("Could not truncate %s", vb.files[FILES_FULLTEXT_LOG]);
+        }
+        /* map the written file that holds now all the pages */
+        index_free(index);
+        index = load(fd);
+    }
+    lock_file(fd, F_UNLCK);
+
+    return index;
+}
+
+/**
+ * Maps the index file and reads the pages of the log given by fd, which must
+ * be locked by the caller. If fd is -1 only the index file is mapped.
+ */
+static Index *load(int fd)
+{
+    char *content;
+    Index *index = index_new();
+
+    if (!index_map(index, vb.files[FILES_FULLTEXT])) {
+        /* start over with an empty index */
+        index_free(index);
+        index = index_new();
+    }
+    if (fd != -1 && (content = read_log(fd))) {
+        index_replay(index, content);
+        g_free(content);
+    }
+
+    return index;
+}
+
+/**
+ * Reads the whole log through given fd. The log is not opened again for
+ * this, because closing that descriptor would release the lock held on the
+ * log.
+ *
+ * Returned string must be freed with g_free.
+ */
+static char *read_log(int fd)
+{
+    struct stat st;
+    ssize_t n;
+    gsize len = 0;
+    char *content;
+
+    if (fstat(fd, &st) || lseek(fd, 0, SEEK_SET) == -1) {
+        return NULL;
+    }
+    content = g_malloc(st.st_size + 1);
+    while (len < (gsize)st.st_size && (n = read(fd, content + len, st.st_size - len)) > 0) {
+        len += n;
+    }
+    content[len] = '\0';
+
+    return content;
+}
+
+static Index *index_new(void)
+{
+    Index *index = g_new0(Index, 1);
+
+    index->docs  = g_ptr_array_new_with_free_func((GDestroyNotify)free_doc);
+    index->uris  = g_hash_table_new(g_str_hash, g_str_equal);
+    index->terms = g_hash_table_new_full(
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_postings
+    );
+
+    return index;
+}
+
+static void index_free(Index *index)
+{
+    if (!index) {
+        return;
+    }
+    if (index->map) {
+        g_mapped_file_unref(index->map);
+    }
+    /* the keys of uris are owned by the docs */
+    g_hash_table_destroy(index->uris);
+    g_hash_table_destroy(index->terms);
+    g_ptr_array_free(index->docs, true);
+    g_free(index);
+}
+
+/**
+ * Maps the index file into memory. The file is never changed in place but
+ * replaced by a new one, so the mapping stays valid after a merge of another
+ * instance.
+ */
+static gboolean index_map(Index *index, const char *file)
+{
+    gsize len;
+    const guchar *data;
+
+    if (!(index->map = g_mapped_file_new(file, false, NULL))) {
+        /* there is no index yet */
+        return true;
+    }
+    data = (const guchar*)g_mapped_file_get_contents(index->map);
+    len  = g_mapped_file_get_length(index->map);
+    if (len < strlen(MAGIC) + 8 || memcmp(data, MAGIC, strlen(MAGIC))) {
+        return false;
+    }
+    index->base   = get_uint32(data + len - 8);
+    index->nterms = get_uint32(data + len - 4);
+    if (4 * ((guint64)index->base + index->nterms) > len - strlen(MAGIC) - 8) {
+        return false;
+    }
+    index->term_table = data + len - 8 - 4 * (gsize)index->nterms;
+    index->doc_table  = index->term_table - 4 * (gsize)index->base;
+
+    return true;
+}
+
+/**
+ * Adds a page of the log to the index. Its id follows the ids of the file and
+ * the pages added before.
+ */
+static void index_add(Index *index, const char *uri, const char *title, char **terms)
+{
+    Postings *p;
+    Doc *doc  = g_new(Doc, 1);
+    guint id  = index->base + index->docs->len;
+
+    doc->uri   = g_strdup(uri);
+    doc->title = g_strdup(title);
+    g_ptr_array_add(index->docs, doc);
+    /* a page visited again gets a new id, the older ones are superseded */
+    g_hash_table_replace(index->uris, doc->uri, GUINT_TO_POINTER(id + 1));
+
+    for (; *terms; terms++) {
+        if (!(p = g_hash_table_lookup(index->terms, *terms))) {
+            p       = g_new0(Postings, 1);
+            p->data = g_byte_array_new();
+            g_hash_table_insert(index->terms, g_strdup(*terms), p);
+        }
+        /* the ids are added in ascending order */
+        put_varint(p->data, p->count ? id - p->last : id);
+        p->last = id;
+        p->count++;
+    }
+}
+
+/**
+ * Adds the pages of the log content to the index. Each line holds the uri,
+ * title and the space separated terms of a page separated by tabs.
+ */
+static void index_replay(Index *index, const char *log)
+{
+    char **lines, **parts, **terms;
+
+    lines = g_strsplit(log, "\n", -1);
+    for (int i = 0; lines[i]; i++) {
+        parts = g_strsplit(lines[i], "\t", 3);
+        if (g_strv_length(parts) == 3) {
+            terms = g_strsplit(parts[2], " ", -1);
+            index_add(index, parts[0], parts[1], terms);
+            g_strfreev(terms);
+        }
+        g_strfreev(parts);
+    }
+    g_strfreev(lines);
+}
+
+/**
+ * Retrieves the ascending ids of the pages of the file and the log that
+ * contain term.
+ *
+ * Returned array must be freed with g_array_free.
+ */
+static GArray *index_lookup(Index *index, const char *term)
+{
+    Reader r;
+    Postings *p;
+    GArray *ids = g_array_new(false, false, sizeof(guint));
+
+    if (file_find(index, term, &r) && !file_postings(index, &r, ids)) {
+        g_array_set_size(ids, 0);
+    }
+    if ((p = g_hash_table_lookup(index->terms, term))) {
+        postings_append(p, ids);
+    }
+
+    return ids;
+}
+
+/**
+ * Retrieves the uri and title of the page with given id from the file or the
+ * log.
+ *
+ * The returned strings must be freed with g_free.
+ */
+static gboolean index_get_doc(Index *index, guint id, char **uri, char **title)
+{
+    Doc *doc;
+    Reader r;
+
+    if (id >= index->base) {
+        doc    = g_ptr_array_index(index->docs, id - index->base);
+        *uri   = g_strdup(doc->uri);
+        *title = g_strdup(doc->title);
+
+        return true;
+    }
+    if (!file_record(index, index->doc_table, id, &r)) {
+        return false;
+    }
+    *uri   = get_string(&r);
+    *title = get_string(&r);
+    if (r.error) {
+        g_free(*uri);
+        g_free(*title);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Indicates if the page with given id is the latest visit of uri. The uris of
+ * the file are unique, so only the log can hold a later visit.
+ */
+static gboolean index_is_latest(Index *index, guint id, const char *uri)
+{
+    guint latest = GPOINTER_TO_UINT(g_hash_table_lookup(index->uris, uri));
+
+    return !latest || latest == id + 1;
+}
+
+/**
+ * Retrieves the lowest id of the latest visits of max pages. Older pages are
+ * beyond the history limit and only evicted on the next merge.
+ */
+static guint index_cut(Index *index, guint max)
+{
+    char *uri, *title;
+    guint id, num = 0;
+
+    if (index->base + index->docs->len <= max) {
+        return 0;
+    }
+    for (id = index->base + index->docs->len; id > 0; id--) {
+        if (!index_get_doc(index, id - 1, &uri, &title)) {
+            continue;
+        }
+        if (index_is_latest(index, id - 1, uri)) {
+            num++;
+        }
+        g_free(uri);
+        g_free(title);
+        if (num == max) {
+            return id - 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the latest max pages of the file and the log into a new index file.
+ * Pages that were visited again are kept only with their latest id. The
+ * records are written as they are made, so that the index is never held in
+ * memory at once, and the file is replaced at the end, so that readers never
+ * see a partial written index.
+ */
+static gboolean index_write(Index *index, const char *file, guint max)
+{
+    int fd;
+    char *tmp, *uri, *title, *term, *key;
+    gboolean res = true;
+    guint total, cut, kept, id, i, j;
+    guint *ids;
+    guint32 offset;
+    gsize pos = 0;
+    gpointer value;
+    GHashTableIter iter;
+    GArray *docs, *terms, *list;
+    GPtrArray *keys;
+    GByteArray *buf;
+    Postings *p;
+    Reader r;
+    int cmp;
+
+    /* the index tells the visited pages, so unlike g_file_set_contents the
+     * file is created only readable by the user */
+    tmp = g_strconcat(file, ".XXXXXX", NULL);
+    if ((fd = g_mkstemp(tmp)) == -1) {
+        g_free(tmp);
+        return false;
+    }
+
+    buf   = g_byte_array_new();
+    docs  = g_array_new(false, false, sizeof(guint32));
+    terms = g_array_new(false, false, sizeof(guint32));
+    g_byte_array_append(buf, (guchar*)MAGIC, strlen(MAGIC));
+
+    /* new id + 1 of the kept pages and 0 for the removed ones, the kept
+     * pages get ascending ids starting at 0 again */
+    total = index->base + index->docs->len;
+    cut   = index_cut(index, max);
+    ids   = g_new0(guint, total);
+    for (id = cut, kept = 0; id < total; id++) {
+        if (!index_get_doc(index, id, &uri, &title)) {
+            continue;
+        }
+        if (!index_is_latest(index, id, uri)) {
+            g_free(uri);
+            g_free(title);
+            continue;
+        }
+        ids[id] = ++kept;
+        offset  = pos + buf->len;
+        g_array_append_val(docs, offset);
+        put_string(buf, uri);
+        put_string(buf, title);
+        g_free(uri);
+        g_free(title);
+        res = flush(fd, buf, &pos, false) && res;
+    }
+
+    /* walk the sorted terms of the file and of the log side by side */
+    keys = g_ptr_array_new();
+    g_hash_table_iter_init(&iter, index->terms);
+    while (g_hash_table_iter_next(&iter, &value, NULL)) {
+        g_ptr_array_add(keys, value);
+    }
+    g_ptr_array_sort(keys, compare_terms);
+
+    list = g_array_new(false, false, sizeof(guint));
+    term = file_term(index, i = 0, &r);
+    for (j = 0; term || j < keys->len;) {
+        key = j < keys->len ? g_ptr_array_index(keys, j) : NULL;
+        cmp = !term ? 1 : !key ? -1 : strcmp(term, key);
+
+        g_array_set_size(list, 0);
+        if (cmp <= 0 && !file_postings(index, &r, list)) {
+            g_array_set_size(list, 0);
+        }
+        if (cmp >= 0) {
+            p = g_hash_table_lookup(index->terms, key);
+            postings_append(p, list);
+        }
+        offset = pos + buf->len;
+        put_term(buf, cmp <= 0 ? term : key, list, ids);
+        if (pos + buf->len > offset) {
+            g_array_append_val(terms, offset);
+        }
+        res = flush(fd, buf, &pos, false) && res;
+
+        if (cmp >= 0) {
+            j++;
+        }
+        if (cmp <= 0) {
+            g_free(term);
+            term = file_term(index, ++i, &r);
+        }
+    }
+    g_array_free(list, true);
+    g_ptr_array_free(keys, true);
+    g_free(ids);
+
+    for (i = 0; i < docs->len; i++) {
+        put_uint32(buf, g_array_index(docs, guint32, i));
+    }
+    for (i = 0; i < terms->len; i++) {
+        put_uint32(buf, g_array_index(terms, guint32, i));
+    }
+    put_uint32(buf, docs->len);
+    put_uint32(buf, terms->len);
+    res = flush(fd, buf, &pos, true) && res;
+    g_array_free(docs, true);
+    g_array_free(terms, true);
+    g_byte_array_free(buf, true);
+
+    res = !close(fd) && res && !rename(tmp, file);
+    if (!res) {
+        unlink(tmp);
+    }
+    g_free(tmp);
+
+    return res;
+}
+
+/**
+ * Sets the reader r to the record at position i of given table of the index
+ * file. The records lie between the magic and the tables.
+ */
+static gboolean file_record(Index *index, const guchar *table, guint i, Reader *r)
+{
+    const guchar *data = (const guchar*)g_mapped_file_get_contents(index->map);
+    guint32 offset     = get_uint32(table + 4 * (gsize)i);
+
+    if (offset < strlen(MAGIC) || offset >= (gsize)(index->doc_table - data)) {
+        return false;
+    }
+    *r = (Reader){data + offset, index->doc_table, false};
+
+    return true;
+}
+
+/**
+ * Retrieves the term at position i of the sorted terms of the index file and
+ * sets r to the postings of the term.
+ *
+ * Returned string must be freed with g_free, NULL is returned if there is no
+ * such term.
+ */
+static char *file_term(Index *index, guint i, Reader *r)
+{
+    char *term;
+
+    if (i >= index->nterms || !file_record(index, index->term_table, i, r)) {
+        return NULL;
+    }
+    term = get_string(r);
+    if (r->error) {
+        g_free(term);
+        return NULL;
+    }
+
+    return term;
+}
+
+/**
+ * Searches the sorted terms of the index file for term and sets r to its
+ * postings.
+ */
+static gboolean file_find(Index *index, const char *term, Reader *r)
+{
+    guint lo = 0, hi = index->nterms, mid;
+    char *found;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (!(found = file_term(index, mid, r))) {
+            return false;
+        }
+        cmp = strcmp(term, found);
+        g_free(found);
+        if (!cmp) {
+            return true;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Appends the ids of the postings the reader r is set to. The ids are checked
+ * to be ascending ids of the docs of the file, because they are used as index
+ * into the docs without further checks.
+ */
+static gboolean file_postings(Index *index, Reader *r, GArray *ids)
+{
+    guint count, len, gap, id = 0;
+
+    count = get_varint(r);
+    len   = get_varint(r);
+    /* each id takes at least one byte */
+    if (r->error || len > (guint)(r->end - r->pos) || !count || count > len) {
+        return false;
+    }
+    r->end = r->pos + len;
+    for (guint i = 0; i < count; i++) {
+        gap = get_varint(r);
+        if (r->error || (i && !gap) || gap >= index->base - id) {
+            return false;
+        }
+        id += gap;
+        g_array_append_val(ids, id);
+    }
+
+    return r->pos == r->end;
+}
+
+static void postings_append(Postings *p, GArray *ids)
+{
+    Reader r = {p->data->data, p->data->data + p->data->len, false};
+    guint id = 0;
+
+    for (guint i = 0; i < p->count; i++) {
+        id += get_varint(&r);
+        g_array_append_val(ids, id);
+    }
+}
+
+/**
+ * Keeps only the ids that are also in other. Both arrays must be sorted.
+ */
+static void intersect(GArray *ids, GArray *other)
+{
+    guint i, j = 0, num = 0, id;
+
+    for (i = 0; i < ids->len && j < other->len; i++) {
+        id = g_array_index(ids, guint, i);
+        while (j < other->len && g_array_index(other, guint, j) < id) {
+            j++;
+        }
+        if (j < other->len && g_array_index(other, guint, j) == id) {
+            g_array_index(ids, guint, num++) = id;
+        }
+    }
+    g_array_set_size(ids, num);
+}
+
+/**
+ * Writes the record of term with the ids of list that are mapped by ids to
+ * the new ones. Nothing is written if none of the ids is kept.
+ */
+static void put_term(GByteArray *buf, const char *term, GArray *list, const guint *ids)
+{
+    guint count = 0, last = 0, id;
+    GByteArray *data = g_byte_array_new();
+
+    for (guint i = 0; i < list->len; i++) {
+        if ((id = ids[g_array_index(list, guint, i)])) {
+            put_varint(data, count ? id - 1 - last : id - 1);
+            last = id - 1;
+            count++;
+        }
+    }
+    if (count) {
+        put_string(buf, term);
+        put_varint(buf, count);
+        put_varint(buf, data->len);
+        g_byte_array_append(buf, data->data, data->len);
+    }
+    g_byte_array_free(data, true);
+}
+
+/**
+ * Writes the collected data of buf to fd once there is enough of it or force
+ * is given. The written bytes are added to pos.
+ */
+static gboolean flush(int fd, GByteArray *buf, gsize *pos, gboolean force)
+{
+    gboolean res = true;
+
+    if (buf->len && (force || buf->len >= WRITE_SIZE)) {
+        res   = write(fd, buf->data, buf->len) == (ssize_t)buf->len;
+        *pos += buf->len;
+        g_byte_array_set_size(buf, 0);
+    }
+
+    return res;
+}
+
+static gint compare_terms(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+/**
+ * Splits text and the optional more text into unique lower case terms of
+ * letters and digits.
+ *
+ * Returned array must be freed with g_strfreev.
+ */
+static char **tokenize(const char *text, const char *more)
+{
+    const char *p;
+    gunichar c;
+    gpointer term;
+    GHashTableIter iter;
+    GPtrArray *list;
+    GString *word = g_string_new("");
+    GHashTable *set = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (; text; text = more, more = NULL) {
+        for (p = text; *p; p = g_utf8_next_char(p)) {
+            c = g_utf8_get_char_validated(p, -1);
+            if (c == (gunichar)-1 || c == (gunichar)-2) {
+                /* the text could have been cut within a char */
+                break;
+            }
+            if (g_unichar_isalnum(c)) {
+                g_string_append_unichar(word, g_unichar_tolower(c));
+                continue;
+            }
+            if (word->len >= TERM_MIN && word->len <= TERM_MAX) {
+                g_hash_table_add(set, g_strdup(word->str));
+            }
+            g_string_truncate(word, 0);
+        }
+        if (word->len >= TERM_MIN && word->len <= TERM_MAX) {
+            g_hash_table_add(set, g_strdup(word->str));
+        }
+        g_string_truncate(word, 0);
+    }
+    g_string_free(word, true);
+
+    /* steal the terms from the set into a NULL terminated array */
+    list = g_ptr_array_sized_new(g_hash_table_size(set) + 1);
+    g_hash_table_iter_init(&iter, set);
+    while (g_hash_table_iter_next(&iter, &term, NULL)) {
+        g_ptr_array_add(list, term);
+        g_hash_table_iter_steal(&iter);
+    }
+    g_ptr_array_add(list, NULL);
+    g_hash_table_destroy(set);
+
+    return (char**)g_ptr_array_free(list, false);
+}
+
+static void lock_file(int fd, short type)
+{
+    struct flock lock = {.l_type = type, .l_start = 0, .l_whence = SEEK_SET, .l_len = 0};
+
+    /* wait until other instances are done with the files */
+    fcntl(fd, F_SETLKW, &lock);
+}
+
+static void put_varint(GByteArray *buf, guint value)
+{
+    guchar byte;
+
+    while (value >= 0x80) {
+        byte = (value & 0x7f) | 0x80;
+        g_byte_array_append(buf, &byte, 1);
+        value >>= 7;
+    }
+    byte = value;
+    g_byte_array_append(buf, &byte, 1);
+}
+
+static void put_string(GByteArray *buf, const char *str)
+{
+    guint len = strlen(str);
+
+    put_varint(buf, len);
+    g_byte_array_append(buf, (const guchar*)str, len);
+}
+
+static void put_uint32(GByteArray *buf, guint32 value)
+{
+    value = GUINT32_TO_LE(value);
+    g_byte_array_append(buf, (const guchar*)&value, 4);
+}
+
+static guint get_varint(Reader *r)
+{
+    guint value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (r->pos >= r->end) {
+            break;
+        }
+        value |= (guint)(*r->pos & 0x7f) << shift;
+        if (!(*r->pos++ & 0x80)) {
+            return value;
+        }
+    }
+    r->error = true;
+
+    return 0;
+}
+
+static char *get_string(Reader *r)
+{
+    guint len = get_varint(r);
+
+    if (r->error || len > (guint)(r->end - r->pos)) {
+        r->error = true;
+        return g_strdup("");
+    }
+    r->pos += len;
+
+    return g_strndup((const char*)r->pos - len, len);
+}
+
+static guint32 get_uint32(const guchar *data)
+{
+    guint32 value;
+
+    memcpy(&value, data, 4);
+
+    return GUINT32_FROM_LE(value);
+}
+
+static void free_doc(Doc *doc)
+{
+    g_free(doc->uri);
+    g_free(doc->title);
+    g_free(doc);
+}
+
+static void free_postings(Postings *p)
+{
+    g_byte_array_free(p->data, true);
+    g_free(p);
+}
+
+static void free_job(Job *job)
+{
+    g_free(job->uri);
+    g_free(job->title);
+    g_free(job->text);
+    g_free(job);
+}
+
+#endif /* FEATURE_FULLTEXT */
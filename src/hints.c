@@ -33,21 +33,78 @@
 #define HINT_VAR "VbHint"
 #define HINT_FILE "hints.js"
 
+/* functions of the hint script api */
+typedef enum {
+    FUNC_INIT,
+    FUNC_CREATE,
+    FUNC_UPDATE,
+    FUNC_CLEAR,
+    FUNC_FIRE,
+    FUNC_FOCUS,
+    FUNC_FOLLOW_LINK,
+    FUNC_LAST
+} HintFunc;
+
+/* actions of the hint script results - must match the values in hints.js */
+typedef enum {
+    ACTION_NONE,
+    ACTION_OVER,
+    ACTION_DONE,
+    ACTION_INSERT,
+    ACTION_DATA
+} HintAction;
+
+static const char *func_names[FUNC_LAST] = {
+    "init", "create", "update", "clear", "fire", "focus", "followLink"
+};
+
 static struct {
-    guint  num;
-    char   prompt[3];
+    guint              num;
+    char               prompt[3];
+    JSGlobalContextRef ctx;              /* context the functions belong to */
+    JSObjectRef        obj;              /* the hint script object */
+    JSObjectRef        func[FUNC_LAST];
+    gboolean           rapid;            /* collect the selected hints */
+    GString            *batch;           /* newline separated sources */
+    guint              batch_len;        /* number of collected sources */
 } hints;
 
 extern VbCore vb;
 
-static void run_script(char *js);
+static JSContextRef get_context(void);
+static void release_functions(void);
+static JSValueRef get_property(JSContextRef ctx, JSObjectRef obj, const char *name);
+static JSObjectRef get_object(JSContextRef ctx, JSObjectRef obj, const char *name);
+static JSValueRef make_string(JSContextRef ctx, const char *str);
+static JSValueRef call_function(HintFunc func, size_t argc, const JSValueRef argv[]);
+static void handle_result(JSValueRef result);
+static JSValueRef done_cb(JSContextRef ctx, JSObjectRef function, JSObjectRef self,
+    size_t argc, const JSValueRef argv[], JSValueRef *exception);
+static void rapid_add(const char *value);
+static void rapid_commit(void);
+static gboolean open_next(gpointer data);
 
 
+/**
+ * Called for each new loaded document. The hint script is not injected here
+ * but on first use, so that pages where no hints are used don't pay for it.
+ */
 void hints_init(WebKitWebFrame *frame)
 {
-    char *value = NULL;
-    vb_eval_script(frame, HINTS_JS, HINT_FILE, &value);
-    g_free(value);
+    release_functions();
+}
+
+/**
+ * Releases the protected hint functions and their context.
+ */
+void hints_cleanup(void)
+{
+    release_functions();
+    if (hints.batch) {
+        g_string_free(hints.batch, true);
+        hints.batch = NULL;
+    }
+    hints.batch_len = 0;
 }
 
 VbResult hints_keypress(int key)
@@ -59,6 +116,18 @@ VbResult hints_keypress(int key)
     }
 
     if (key == KEY_CR) {
+        /* in rapid mode <CR> without any filter uses the collected hints */
+        if (hints.rapid && hints.batch_len && !hints.num) {
+            char *text = vb_get_input_text();
+            gboolean filtered = strlen(text) > 2;
+            g_free(text);
+            if (!filtered) {
+                rapid_commit();
+                mode_enter('n');
+
+                return RESULT_COMPLETE;
+            }
+        }
         hints_fire();
 
         return RESULT_COMPLETE;
@@ -98,151 +167,427 @@ VbResult hints_keypress(int key)
 
 void hints_clear(void)
 {
-    char *js, *value = NULL;
-
     if (vb.mode->flags & FLAG_HINTING) {
         vb.mode->flags &= ~FLAG_HINTING;
         vb_set_input_text("");
-        js = g_strconcat(HINT_VAR, ".clear();", NULL);
-        vb_eval_script(webkit_web_view_get_main_frame(vb.gui.webview), js, HINT_FILE, &value);
-        g_free(value);
-        g_free(js);
+        /* without the functions there can't be any hints to clear */
+        if (hints.ctx) {
+            call_function(FUNC_CLEAR, 0, NULL);
+        }
 
         g_signal_emit_by_name(vb.gui.webview, "hovering-over-link", NULL, NULL);
     }
+    /* uncommitted selections of the rapid mode are dropped */
+    if (hints.batch) {
+        g_string_free(hints.batch, true);
+        hints.batch = NULL;
+    }
+    hints.batch_len = 0;
+    hints.rapid     = false;
+}
+
+/**
+ * Sets if the next started hinting collects the selected hints instead of
+ * using each of them immediately.
+ */
+void hints_set_rapid(gboolean rapid)
+{
+    hints.rapid = rapid;
 }
 
 void hints_create(const char *input)
 {
-    char *js = NULL;
+    JSContextRef ctx;
+    JSValueRef args[4];
 
     /* unset number filter - this is required to remove the last char from
      * inputbox on backspace also if there was used a number filter prior */
     hints.num = 0;
 
+    if (!(ctx = get_context())) {
+        mode_enter('n');
+        return;
+    }
+
     if (!(vb.mode->flags & FLAG_HINTING)) {
         vb.mode->flags |= FLAG_HINTING;
 
         /* save the prefix of the hinting mode for later use */
         strncpy(hints.prompt, input, 2);
 
-        js = g_strdup_printf("%s.init('%s', %d);", HINT_VAR, hints.prompt, MAXIMUM_HINTS);
-
-        run_script(js);
-        g_free(js);
+        args[0] = make_string(ctx, hints.prompt);
+        args[1] = JSValueMakeNumber(ctx, MAXIMUM_HINTS);
+        args[2] = JSValueMakeBoolean(ctx, hints.rapid);
+        args[3] = JSObjectMakeFunctionWithCallback(ctx, NULL, done_cb);
+        handle_result(call_function(FUNC_INIT, 4, args));
     }
 
-    js = g_strdup_printf("%s.create('%s');", HINT_VAR, input + 2);
-    run_script(js);
-    g_free(js);
+    args[0] = make_string(ctx, input + 2);
+    handle_result(call_function(FUNC_CREATE, 1, args));
 }
 
 void hints_update(int num)
 {
-    char *js = g_strdup_printf("%s.update(%d);", HINT_VAR, hints.num);
-    run_script(js);
-    g_free(js);
+    JSContextRef ctx;
+    JSValueRef arg;
+
+    if ((ctx = get_context())) {
+        arg = JSValueMakeNumber(ctx, num);
+        handle_result(call_function(FUNC_UPDATE, 1, &arg));
+    }
 }
 
 void hints_focus_next(const gboolean back)
 {
-    char *js = g_strdup_printf("%s.focus(%d);", HINT_VAR, back);
-    run_script(js);
-    g_free(js);
+    JSContextRef ctx;
+    JSValueRef arg;
+
+    if ((ctx = get_context())) {
+        arg = JSValueMakeBoolean(ctx, back);
+        handle_result(call_function(FUNC_FOCUS, 1, &arg));
+    }
 }
 
 void hints_fire(void)
 {
-    char *js = g_strconcat(HINT_VAR, ".fire();", NULL);
-    run_script(js);
-    g_free(js);
+    if (get_context()) {
+        handle_result(call_function(FUNC_FIRE, 0, NULL));
+    }
 }
 
 void hints_follow_link(const gboolean back, int count)
 {
-    char *pattern = back ? vb.config.prevpattern : vb.config.nextpattern;
-    char *js      = g_strdup_printf(
-        "%s.followLink('%s', [%s], %d);", HINT_VAR,
-        back ? "prev" : "next",
-        pattern,
-        count
-    );
-    run_script(js);
-    g_free(js);
+    JSContextRef ctx;
+    JSValueRef args[3];
+
+    if ((ctx = get_context())) {
+        args[0] = make_string(ctx, back ? "prev" : "next");
+        args[1] = make_string(ctx, back ? vb.config.prevpattern : vb.config.nextpattern);
+        args[2] = JSValueMakeNumber(ctx, count);
+        handle_result(call_function(FUNC_FOLLOW_LINK, 3, args));
+    }
 }
 
-static void run_script(char *js)
+/**
+ * Retrieves the context of the main frame with the functions of the hint
+ * script looked up. The script is evaluated in the frame if this was not done
+ * yet for the current document. The functions are kept until the next
+ * document is loaded, so that they don't need to be compiled and looked up
+ * for each call.
+ */
+static JSContextRef get_context(void)
 {
-    char mode, *value = NULL;
+    char *value = NULL;
+    JSGlobalContextRef ctx;
+    JSObjectRef obj;
+    WebKitWebFrame *frame = webkit_web_view_get_main_frame(vb.gui.webview);
+
+    ctx = webkit_web_frame_get_global_context(frame);
+    if (hints.ctx == ctx) {
+        return ctx;
+    }
+    release_functions();
 
-    gboolean success = vb_eval_script(
-        webkit_web_view_get_main_frame(vb.gui.webview), js, HINT_FILE, &value
-    );
-    if (!success) {
-        fprintf(stderr, "%s\n", value);
+    /* the document could still have the script from an earlier injection,
+     * for example if it was restored from page cache */
+    if (!(obj = get_object(ctx, JSContextGetGlobalObject(ctx), HINT_VAR))) {
+        vb_eval_script(frame, HINTS_JS, HINT_FILE, &value);
         g_free(value);
+        if (!(obj = get_object(ctx, JSContextGetGlobalObject(ctx), HINT_VAR))) {
+            return NULL;
+        }
+    }
+    for (int i = 0; i < FUNC_LAST; i++) {
+        hints.func[i] = get_object(ctx, obj, func_names[i]);
+        if (!hints.func[i] || !JSObjectIsFunction(ctx, hints.func[i])) {
+            return NULL;
+        }
+    }
 
-        mode_enter('n');
+    /* keep the functions from being garbage collected */
+    hints.ctx = JSGlobalContextRetain(ctx);
+    hints.obj = obj;
+    JSValueProtect(ctx, obj);
+    for (int i = 0; i < FUNC_LAST; i++) {
+        JSValueProtect(ctx, hints.func[i]);
+    }
+
+    return ctx;
+}
 
+static void release_functions(void)
+{
+    if (!hints.ctx) {
         return;
     }
+    for (int i = 0; i < FUNC_LAST; i++) {
+        JSValueUnprotect(hints.ctx, hints.func[i]);
+        hints.func[i] = NULL;
+    }
+    JSValueUnprotect(hints.ctx, hints.obj);
+    hints.obj = NULL;
+    JSGlobalContextRelease(hints.ctx);
+    hints.ctx = NULL;
+}
+
+static JSValueRef get_property(JSContextRef ctx, JSObjectRef obj, const char *name)
+{
+    JSStringRef str = JSStringCreateWithUTF8CString(name);
+    JSValueRef value = JSObjectGetProperty(ctx, obj, str, NULL);
+    JSStringRelease(str);
+
+    return value;
+}
+
+static JSObjectRef get_object(JSContextRef ctx, JSObjectRef obj, const char *name)
+{
+    JSValueRef value = get_property(ctx, obj, name);
+
+    if (!value || !JSValueIsObject(ctx, value)) {
+        return NULL;
+    }
+    return JSValueToObject(ctx, value, NULL);
+}
+
+static JSValueRef make_string(JSContextRef ctx, const char *str)
+{
+    JSStringRef js_str = JSStringCreateWithUTF8CString(str);
+    JSValueRef value   = JSValueMakeString(ctx, js_str);
+    JSStringRelease(js_str);
+
+    return value;
+}
+
+/**
+ * Calls the function of the hint script with given arguments. The function
+ * must have been looked up with get_context() before.
+ *
+ * Returns the result of the function or NULL on error.
+ */
+static JSValueRef call_function(HintFunc func, size_t argc, const JSValueRef argv[])
+{
+    char *error;
+    JSValueRef exception = NULL, result;
+
+    result = JSObjectCallAsFunction(hints.ctx, hints.func[func], hints.obj, argc, argv, &exception);
+    if (exception) {
+        error = vb_jsref_to_string(hints.ctx, exception);
+        fprintf(stderr, "%s\n", error);
+        g_free(error);
+
+        /* the document might have dropped the script, so look up the
+         * functions on next call again */
+        release_functions();
+
+        return NULL;
+    }
+
+    return result;
+}
+
+/**
+ * Processes the result object of the hint script that holds the action to
+ * perform and an optional string value.
+ */
+static void handle_result(JSValueRef result)
+{
+    char mode, *value;
+    HintAction action;
+    JSContextRef ctx = hints.ctx;
+    JSObjectRef obj;
+    Arg a = {0};
+
+    if (!result) {
+        mode_enter('n');
+        return;
+    }
+    /* some functions don't return anything */
+    if (!JSValueIsObject(ctx, result)) {
+        return;
+    }
+    obj    = JSValueToObject(ctx, result, NULL);
+    action = (HintAction)JSValueToNumber(ctx, get_property(ctx, obj, "action"), NULL);
+    value  = vb_jsref_to_string(ctx, get_property(ctx, obj, "value"));
 
     /* check the second char of the prompt ';X' */
     mode = hints.prompt[1];
 
-    if (!strncmp(value, "OVER:", 5)) {
-        g_signal_emit_by_name(
-            vb.gui.webview, "hovering-over-link", NULL, *(value + 5) == '\0' ? NULL : (value + 5)
-        );
-    } else if (!strncmp(value, "DONE:", 5)) {
-        mode_enter('n');
-    } else if (!strncmp(value, "INSERT:", 7)) {
-        mode_enter('i');
-        if (mode == 'e') {
-            input_open_editor();
-        }
-    } else if (!strncmp(value, "DATA:", 5)) {
-        /* switch first to normal mode - else we would clear the inputbox on
-         * switching mode also if we want to show yanked data */
-        mode_enter('n');
-        char *v   = (value + 5);
-        Arg a     = {0};
-        switch (mode) {
-            /* used if images should be opened */
-            case 'i':
-            case 'I':
-                a.s = v;
-                a.i = (mode == 'I') ? VB_TARGET_NEW : VB_TARGET_CURRENT;
-                vb_load_uri(&a);
+    switch (action) {
+        case ACTION_OVER:
+            g_signal_emit_by_name(
+                vb.gui.webview, "hovering-over-link", NULL, *value == '\0' ? NULL : value
+            );
+            break;
+
+        case ACTION_DONE:
+            rapid_commit();
+            mode_enter('n');
+            break;
+
+        case ACTION_INSERT:
+            rapid_commit();
+            mode_enter('i');
+            if (mode == 'e') {
+                input_open_editor();
+            }
+            break;
+
+        case ACTION_DATA:
+            if (hints.rapid) {
+                rapid_add(value);
+                /* start over with all hints for the next selection */
+                vb_set_input_text(hints.prompt);
                 break;
+            }
+            /* switch first to normal mode - else we would clear the inputbox
+             * on switching mode also if we want to show yanked data */
+            mode_enter('n');
+            switch (mode) {
+                /* used if images should be opened */
+                case 'i':
+                case 'I':
+                    a.s = value;
+                    a.i = (mode == 'I') ? VB_TARGET_NEW : VB_TARGET_CURRENT;
+                    vb_load_uri(&a);
+                    break;
+
+                case 'O':
+                case 'T':
+                    vb_echo(VB_MSG_NORMAL, false, "%s %s", (mode == 'T') ? ":tabopen" : ":open", value);
+                    mode_enter('c');
+                    break;
+
+                case 's':
+                    a.s = value;
+                    a.i = COMMAND_SAVE_URI;
+                    command_save(&a);
+                    break;
+
+                case 'y':
+                    a.i = COMMAND_YANK_ARG;
+                    a.s = value;
+                    command_yank(&a);
+                    break;
 
-            case 'O':
-            case 'T':
-                vb_echo(VB_MSG_NORMAL, false, "%s %s", (mode == 'T') ? ":tabopen" : ":open", v);
-                mode_enter('c');
-                break;
+#ifdef FEATURE_QUEUE
+                case 'p':
+                case 'P':
+                    a.s = value;
+                    a.i = (mode == 'P') ? COMMAND_QUEUE_UNSHIFT : COMMAND_QUEUE_PUSH;
+                    command_queue(&a);
+                    break;
+#endif
+            }
+            break;
 
-            case 's':
-                a.s = v;
-                a.i = COMMAND_SAVE_URI;
-                command_save(&a);
-                break;
+        case ACTION_NONE:
+            break;
+    }
+    g_free(value);
+}
 
-            case 'y':
-                a.i = COMMAND_YANK_ARG;
-                a.s = v;
-                command_yank(&a);
-                break;
+/**
+ * Called by the hint script with the result of the hints that were created
+ * in the background, because the first time slice was not enough.
+ */
+static JSValueRef done_cb(JSContextRef ctx, JSObjectRef function, JSObjectRef self,
+    size_t argc, const JSValueRef argv[], JSValueRef *exception)
+{
+    /* the hinting might have been left meanwhile */
+    if (argc && hints.ctx && (vb.mode->flags & FLAG_HINTING)) {
+        handle_result(argv[0]);
+    }
+
+    return JSValueMakeUndefined(ctx);
+}
+
+static void rapid_add(const char *value)
+{
+    if (!*value) {
+        return;
+    }
+    if (!hints.batch) {
+        hints.batch = g_string_new(value);
+    } else {
+        g_string_append_c(hints.batch, '\n');
+        g_string_append(hints.batch, value);
+    }
+    hints.batch_len++;
+}
+
+/**
+ * Uses all the sources collected in rapid hint mode at once.
+ */
+static void rapid_commit(void)
+{
+    char **uris;
+    GQueue *queue;
+    Arg a = {0};
 
+    if (!hints.batch_len) {
+        return;
+    }
+
+    switch (hints.prompt[1]) {
 #ifdef FEATURE_QUEUE
-            case 'p':
-            case 'P':
-                a.s = v;
-                a.i = (mode == 'P') ? COMMAND_QUEUE_UNSHIFT : COMMAND_QUEUE_PUSH;
-                command_queue(&a);
-                break;
+        case 'p':
+        case 'P':
+            /* all sources are written to the queue file at once */
+            a.s = hints.batch->str;
+            a.i = (hints.prompt[1] == 'P') ? COMMAND_QUEUE_UNSHIFT : COMMAND_QUEUE_PUSH;
+            command_queue(&a);
+            break;
 #endif
-        }
+
+        case 'y':
+            a.s = hints.batch->str;
+            a.i = VB_CLIPBOARD_PRIMARY|VB_CLIPBOARD_SECONDARY;
+            vb_set_clipboard(&a);
+            vb_echo_force(VB_MSG_NORMAL, false, "Yanked %d uris", hints.batch_len);
+            break;
+
+        case 's':
+            uris = g_strsplit(hints.batch->str, "\n", -1);
+            for (int i = 0; uris[i]; i++) {
+                a.s = uris[i];
+                a.i = COMMAND_SAVE_URI;
+                command_save(&a);
+            }
+            g_strfreev(uris);
+            break;
+
+        case 't':
+            /* the windows are opened one after another so that they don't
+             * all start loading in the same moment */
+            uris  = g_strsplit(hints.batch->str, "\n", -1);
+            queue = g_queue_new();
+            for (int i = 0; uris[i]; i++) {
+                g_queue_push_tail(queue, uris[i]);
+            }
+            /* the strings are owned by the queue now */
+            g_free(uris);
+            if (open_next(queue)) {
+                g_timeout_add(RAPID_HINT_OPEN_DELAY, open_next, queue);
+            }
+            break;
     }
-    g_free(value);
+
+    g_string_truncate(hints.batch, 0);
+    hints.batch_len = 0;
+}
+
+static gboolean open_next(gpointer data)
+{
+    GQueue *queue = data;
+    char *uri     = g_queue_pop_head(queue);
+
+    if (uri) {
+        vb_load_uri(&(Arg){VB_TARGET_NEW, uri});
+        g_free(uri);
+    }
+    if (g_queue_is_empty(queue)) {
+        g_queue_free(queue);
+        return false;
+    }
+    return true;
 }
@@ -23,12 +23,14 @@
 #include "main.h"
 
 void hints_init(WebKitWebFrame *frame);
+void hints_cleanup(void);
 VbResult hints_keypress(int key);
 void hints_create(const char *input);
 void hints_update(int num);
 void hints_fire(void);
 void hints_follow_link(const gboolean back, int count);
 void hints_clear(void);
+void hints_set_rapid(gboolean rapid);
 void hints_focus_next(const gboolean back);
 
 #endif /* end of include guard: _HINTS_H */
@@ -1,164 +1,617 @@
 var VbHint = (function(){
     'use strict';
 
-    var hConts   = [],               /* holds the hintcontainers of the different documents */
+    var overlay  = null,             /* fixed layer of the top document holding the labels */
+        layers   = [],               /* scroll handlers of the layers of the hinted documents */
         hints    = [],               /* holds all hint data (hinted element, label, number) */
+        shown    = hints,            /* hints matching the number filter */
+        updates  = 0,                /* counts the number filter changes */
         ixdFocus = 0,                /* index of current focused hint */
         cId      = "_hintContainer", /* id of the conteiner holding the hint lables */
         lClass   = "_hintLabel",     /* class used on the hint labels with the hint numbers */
-        hClass   = "_hintElem",      /* marks hinted elements */
-        fClass   = "_hintFocus",     /* marks focused element and focued hint */
+        hClass   = "_hintElem",      /* boxes that highlight the hinted elements */
+        fClass   = "_hintFocus",     /* marks focused box and focued hint */
+        nClass   = "_hintHidden",    /* hides labels not matching the number filter */
+        sliceTime = 8,               /* max milliseconds to block the page for hinting */
+        job       = null,            /* running progressive hint creation */
+        filter    = null,            /* filter text of the hints or null if they can't be narrowed */
+        compiled  = {},              /* regex lists by pattern setting for followLink */
+        /* selectors to find the candidates of the hint modes for the cache */
+        selectors = {
+            l: "[href],[onclick],.lk,[role],[tabindex],input,textarea,button,select",
+            e: "input,textarea",
+            i: "img[src]"
+        },
+        /* attributes that can change the candidates of the hint modes */
+        observed  = ["href", "onclick", "class", "role", "tabindex", "type", "disabled", "readonly", "src"],
+        /* actions of the results - the values must match the HintAction */
+        /* enum in hints.c */
+        NONE   = 0,
+        OVER   = 1,                  /* hovering over a hinted link */
+        DONE   = 2,                  /* hinting is done */
+        INSERT = 3,                  /* an editable element was focused */
+        DATA   = 4,                  /* the source of the hinted element is returned */
         config;
 
+    /* retrieves the result object of the api functions */
+    function result(action, value) {
+        return {action: action, value: value || ""};
+    }
+
     function create(inputText) {
+        var s = (inputText || "").toLowerCase();
+
+        /* if the filter text was only extended the hints can be filtered */
+        /* by their captured text without walking the documents again */
+        if (filter !== null && hints.length && s.indexOf(filter) === 0) {
+            drain();
+            if (filter !== null) {
+                return narrow(s);
+            }
+        }
         clear();
 
-        var count = 0;
+        job = {
+            count:   0,                    /* number of created hints */
+            filter:  s,
+            matcher: getMatcher(),
+            docs:    [],                   /* documents still to process */
+            timer:   0,
+            focused: false
+        };
+        addDoc(window);
 
-        function helper(win, offsets) {
-            /* document may be undefined for frames out of the same origin */
-            /* policy and will break the whole code - so we check this before */
-            if (win.document === undefined) {
-                return;
-            }
+        /* if the first time slice is not enough, continue in the */
+        /* background and show the labels as they are created - the result */
+        /* of the completed job is given to the done callback then */
+        if (!run(sliceTime)) {
+            job.timer   = window.setTimeout(step, 0);
+            job.focused = hints.length > 0;
+            return hints.length ? focusHint(0) : result(NONE);
+        }
+        return complete();
+    }
 
-            offsets        = offsets || {left: 0, right: 0, top: 0, bottom: 0};
-            offsets.right  = win.innerWidth  - offsets.right;
-            offsets.bottom = win.innerHeight - offsets.bottom;
+    /* ends the hint job and retrieves the result for the created hints */
+    function complete() {
+        var s = job.filter;
+        finish();
 
-            function isVisible(e) {
-                if (e === undefined) {
-                    return false;
+        /* in rapid mode the unfiltered hints are created again after each */
+        /* selection, so a single hint must not be fired on its own */
+        if (hints.length <= 1 && (s || !config.rapid)) {
+            return fire(0);
+        }
+        return focusHint(0);
+    }
+
+    /* removes the hints that don't match the extended filter text s and */
+    /* numbers the remaining hints again */
+    function narrow(s) {
+        var keep = [], focused = getHint(ixdFocus), i, hint;
+
+        for (i = 0; i < hints.length; i++) {
+            hint = hints[i];
+            if (hint.text.indexOf(s) !== -1) {
+                /* the number filter is reset by new filter text */
+                if (hint.hidden) {
+                    setHidden(hint, false);
                 }
-                var rect = e.getBoundingClientRect();
-                if (!rect ||
-                    rect.top > offsets.bottom || rect.bottom < offsets.top ||
-                    rect.left > offsets.right || rect.right < offsets.left ||
-                    !rect.width || !rect.height
-                ) {
-                    return false;
+                keep.push(hint);
+            } else {
+                hint.label.parentNode.removeChild(hint.label);
+                hint.box.parentNode.removeChild(hint.box);
+            }
+        }
+        for (i = 0; i < keep.length; i++) {
+            hint = keep[i];
+            if (hint.num !== i + 1) {
+                hint.num = i + 1;
+                hint.label.textContent = getLabelText(hint);
+            }
+        }
+        hints    = shown = keep;
+        filter   = s;
+        ixdFocus = Math.max(hints.indexOf(focused), 0);
+
+        if (hints.length <= 1) {
+            return fire(0);
+        }
+        return focusHint(0);
+    }
+
+    /* adds a document of window to the running hint job - for frames the */
+    /* parent document and the position of the frame in it are given */
+    function addDoc(win, offsets, parent, x, y) {
+        /* document may be undefined for frames out of the same origin */
+        /* policy and will break the whole code - so we check this before */
+        if (win.document === undefined) {
+            return;
+        }
+
+        offsets        = offsets || {left: 0, right: 0, top: 0, bottom: 0};
+        offsets.right  = win.innerWidth  - offsets.right;
+        offsets.bottom = win.innerHeight - offsets.bottom;
+
+        var doc  = win.document,
+            root = doc.documentElement,
+            start = getStart(doc, offsets) || root,
+            d = {
+                win:     win,
+                doc:     doc,
+                offsets: offsets,
+                root:    root,
+                start:   start,
+                list:    getCandidates(doc),
+                walker:  null,
+                next:    start,  /* next element to check */
+                pos:     0,      /* position of next element in list */
+                first:   0,      /* position of start in list */
+                back:    false,  /* true if walking backward from start */
+                parent:  parent || null,
+                x:       x || 0,
+                y:       y || 0,
+                frames:  [],
+                layer:   null    /* overlay layer for the labels of the document */
+            },
+            i, e, rect;
+
+        if (d.list) {
+            d.first = d.pos = position(d.list, start);
+        } else {
+            d.walker = doc.createTreeWalker(root, NodeFilter.SHOW_ELEMENT, null, false);
+        }
+
+        /* get the positions of the frames before the document is changed */
+        for (i = 0; i < win.frames.length; i++) {
+            e = win.frames[i].frameElement;
+            if (e && (rect = e.getBoundingClientRect()) && isVisible(d, e, rect)) {
+                d.frames.push({
+                    win:  win.frames[i],
+                    rect: rect,
+                    /* position of the frames viewport without the border */
+                    x:    rect.left + e.clientLeft,
+                    y:    rect.top + e.clientTop
+                });
+            }
+        }
+        job.docs.push(d);
+    }
+
+    /* retrieves an element at the top of the visible area to start the */
+    /* walk at, so that the visible elements are found first - the points */
+    /* are probed downwards because the upper edge is often covered only */
+    /* by the document body */
+    function getStart(doc, o) {
+        var x = (o.left + o.right) / 2, y, e;
+        for (y = o.top + 1; y < o.bottom; y += 20) {
+            e = doc.elementFromPoint(x, y);
+            if (e && e !== doc.body && e !== doc.documentElement) {
+                return e;
+            }
+        }
+        return null;
+    }
+
+    /* retrieves the candidates of the current hint mode of the document in */
+    /* document order or null if they can't be cached - the candidates are */
+    /* collected on first use and afterwards only changed by the recorded */
+    /* mutations of the document until the document is left */
+    function getCandidates(doc) {
+        var win      = doc.defaultView,
+            Observer = win.MutationObserver || win.WebKitMutationObserver,
+            cache    = doc.vbHintCache,
+            mode     = config.mode,
+            c, all, valid, i, e;
+
+        if (!Observer || !selectors[mode]) {
+            return null;
+        }
+        if (!cache) {
+            cache = doc.vbHintCache = {
+                observer: new Observer(function (records) {
+                    observe(doc, records);
+                }),
+                modes: {}
+            };
+            cache.observer.observe(doc, {
+                childList: true, subtree: true, attributes: true, attributeFilter: observed
+            });
+            /* the cache is kept for further hinting until the page is */
+            /* unloaded or put into the page cache */
+            win.addEventListener("pagehide", function () {
+                dropCache(doc);
+            }, false);
+        } else {
+            /* apply the mutations that are not delivered yet */
+            observe(doc, cache.observer.takeRecords());
+        }
+
+        c = cache.modes[mode];
+        if (!c) {
+            c = cache.modes[mode] = {
+                mark:    "_vbHint" + mode, /* expando on elements in list */
+                sel:     selectors[mode],
+                match:   getMatcher().candidate,
+                list:    [],
+                pending: [],               /* added or changed elements */
+                dirty:   false             /* list contains removed elements */
+            };
+            all = doc.querySelectorAll(c.sel);
+            for (i = 0; i < all.length; i++) {
+                e = all[i];
+                if (c.match(e)) {
+                    e[c.mark] = true;
+                    c.list.push(e);
                 }
+            }
+            return c.list;
+        }
 
-                var s = win.getComputedStyle(e, null);
-                return s.display !== "none" && s.visibility == "visible";
+        if (c.dirty) {
+            c.dirty = false;
+            c.list  = c.list.filter(function (e) {
+                if (e[c.mark] && doc.documentElement.contains(e)) {
+                    return true;
+                }
+                e[c.mark] = false;
+                return false;
+            });
+        }
+        if (c.pending.length) {
+            valid = [];
+            for (i = 0; i < c.pending.length; i++) {
+                e = c.pending[i];
+                if (!e[c.mark] && doc.documentElement.contains(e) && c.match(e)) {
+                    e[c.mark] = true;
+                    valid.push(e);
+                }
             }
+            c.pending = [];
+            /* sort many new elements at once instead of inserting them */
+            if (valid.length > 32) {
+                c.list = c.list.concat(valid).sort(function (a, b) {
+                    return a === b ? 0 : (a.compareDocumentPosition(b) & 4 ? -1 : 1);
+                });
+            } else {
+                for (i = 0; i < valid.length; i++) {
+                    c.list.splice(position(c.list, valid[i]), 0, valid[i]);
+                }
+            }
+        }
+        return c.list;
+    }
+
+    /* records the mutations of the document in the candidate caches - */
+    /* removed elements are only marked to be filtered on next use */
+    function observe(doc, records) {
+        var modes = doc.vbHintCache.modes, c, m, r, i, j, k, n, all;
 
-            var doc   = win.document,
-                xpath = getXpath(inputText),
-                res   = doc.evaluate(
-                    xpath, doc,
-                    function (p) {return "http://www.w3.org/1999/xhtml";},
-                    XPathResult.ORDERED_NODE_SNAPSHOT_TYPE, null
-                ),
-                /* generate basic hint element which will be cloned and updated later */
-                labelTmpl = doc.createElement("span"),
-                e, i;
-
-            labelTmpl.className = lClass;
-
-            var containerOffsets = getOffsets(doc),
-                offsetX = containerOffsets[0],
-                offsetY = containerOffsets[1],
-                fragment = doc.createDocumentFragment(),
-                rect, label, text;
-
-            /* collect all visible elements in hints array */
-            for (i = 0; i < res.snapshotLength; i++) {
-                e = res.snapshotItem(i);
-                if (!isVisible(e)) {
+        for (m in modes) {
+            c = modes[m];
+            for (i = 0; i < records.length; i++) {
+                r = records[i];
+                if (r.type === "attributes") {
+                    n = r.target;
+                    if (c.match(n)) {
+                        if (!n[c.mark]) {
+                            c.pending.push(n);
+                        }
+                    } else if (n[c.mark]) {
+                        n[c.mark] = false;
+                        c.dirty   = true;
+                    }
                     continue;
                 }
-
-                count++;
-
-                /* create the hint label with number */
-                rect  = e.getBoundingClientRect();
-                label = labelTmpl.cloneNode(false);
-                label.style.left = Math.max((rect.left + offsetX), offsetX) + "px";
-                label.style.top  = Math.max((rect.top  + offsetY), offsetY) + "px";
-                label.innerText  = count;
-
-                /* if hinted element is an image - show title or alt of the image in hint label */
-                /* this allows to see how to filter for the image */
-                text = "";
-                if (e instanceof HTMLImageElement) {
-                    text = e.alt || e.title;
-                } else if (e.firstElementChild instanceof HTMLImageElement && /^\s*$/.test(e.textContent)) {
-                    text = e.firstElementChild.title || e.firstElementChild.alt;
+                if (r.removedNodes.length) {
+                    c.dirty = true;
                 }
-                if (text) {
-                    label.innerText += ": " + text.substr(0, 20);
+                for (j = 0; j < r.addedNodes.length; j++) {
+                    n = r.addedNodes[j];
+                    if (n.nodeType !== 1) {
+                        continue;
+                    }
+                    all = [n].concat(Array.prototype.slice.call(n.querySelectorAll(c.sel)));
+                    for (k = 0; k < all.length; k++) {
+                        n = all[k];
+                        /* moved elements must be placed at their new */
+                        /* position in the list */
+                        if (n[c.mark]) {
+                            n[c.mark] = false;
+                            c.dirty   = true;
+                        }
+                        c.pending.push(n);
+                    }
+                }
+            }
+        }
+    }
+
+    /* retrieves the position of the first element in list that does not */
+    /* precede e in document order */
+    function position(list, e) {
+        var lo = 0, hi = list.length, mid;
+        while (lo < hi) {
+            mid = (lo + hi) >> 1;
+            if (list[mid].compareDocumentPosition(e) & 4) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /* retrieves the next element of the document to check - first all */
+    /* elements from start to the end of the document are walked and then */
+    /* backward from start to the beginning, so that elements in the visible */
+    /* area are found first */
+    function nextElem(d) {
+        if (d.list) {
+            if (!d.back) {
+                if (d.pos < d.list.length) {
+                    return d.list[d.pos++];
                 }
+                d.back = true;
+                d.pos  = d.first - 1;
+            }
+            return d.pos >= 0 ? d.list[d.pos--] : null;
+        }
 
-                /* add the hint class to the hinted element */
-                e.classList.add(hClass);
-                fragment.appendChild(label);
+        var e = d.next;
+        if (!e) {
+            return null;
+        }
+        d.walker.currentNode = e;
+        if (!d.back) {
+            d.next = d.walker.nextNode();
+            if (!d.next && d.start !== d.root) {
+                /* turn around and walk backward from start */
+                d.back   = true;
+                d.walker.currentNode = d.start;
+                d.next   = d.walker.previousNode();
+            }
+        } else {
+            d.next = d.walker.previousNode();
+        }
+        return e;
+    }
 
-                hints.push({
-                    e:     e,
-                    num:   count,
-                    label: label
-                });
+    /* processes the documents of the hint job until given time in */
+    /* milliseconds is used up - returns true if the job is complete */
+    function run(limit) {
+        var end = Date.now() + limit, m = job.matcher, n = 0, d, e, rect, text, label, found, i, r;
 
-                if (count >= config.maxHints) {
+        while ((d = job.docs[0]) && job.count < config.maxHints) {
+            /* read phase - collect the positions of all visible elements */
+            /* before anything is changed in the document, so that the */
+            /* layout is calculated only once per time slice */
+            found = [];
+            while (job.count + found.length < config.maxHints && (e = nextElem(d))) {
+                /* elements of the cache are known to be candidates */
+                if ((d.list || m.candidate(e)) && (text = m.text(e)).indexOf(job.filter) !== -1) {
+                    rect = e.getBoundingClientRect();
+                    if (isVisible(d, e, rect)) {
+                        /* if hinted element is an image - show title or alt of the image in hint label */
+                        /* this allows to see how to filter for the image */
+                        label = "";
+                        if (e instanceof HTMLImageElement) {
+                            label = e.alt || e.title;
+                        } else if (e.firstElementChild instanceof HTMLImageElement && /^\s*$/.test(e.textContent)) {
+                            label = e.firstElementChild.title || e.firstElementChild.alt;
+                        }
+                        found.push({e: e, rect: rect, text: text, label: label});
+                    }
+                }
+                if (!(++n % 32) && Date.now() > end) {
                     break;
                 }
             }
 
-            /* append the fragment to the document */
-            var hDiv = doc.createElement("div");
-            hDiv.id  = cId;
-            hDiv.appendChild(fragment);
-            doc.documentElement.appendChild(hDiv);
-            /* create the default style sheet */
-            createStyle(doc);
-
-            hConts.push(hDiv);
-
-            /* recurse into any iframe or frame element */
-            for (var f in win.frames) {
-                var e = f.frameElement;
-                if (isVisible(e)) {
-                    var rect = e.getBoundingClientRect();
-                    helper(f, {
-                        left:   Math.max(offsets.left - rect.left, 0),
-                        right:  Math.max(rect.right   - offsets.right, 0),
-                        top:    Math.max(offsets.top  - rect.top, 0),
-                        bottom: Math.max(rect.bottom  - offsets.bottom, 0)
-                    });
+            /* write phase */
+            addLabels(d, found);
+
+            if (e) {
+                /* stopped because of the time limit or max hints reached */
+                if (job.count >= config.maxHints) {
+                    break;
                 }
+                return false;
+            }
+
+            /* document is done - continue with its frames */
+            job.docs.shift();
+            for (i = 0; i < d.frames.length; i++) {
+                r = d.frames[i].rect;
+                addDoc(d.frames[i].win, {
+                    left:   Math.max(d.offsets.left - r.left, 0),
+                    right:  Math.max(r.right   - d.offsets.right, 0),
+                    top:    Math.max(d.offsets.top  - r.top, 0),
+                    bottom: Math.max(r.bottom  - d.offsets.bottom, 0)
+                }, d, d.frames[i].x, d.frames[i].y);
             }
         }
+        return true;
+    }
 
-        helper(window);
+    /* runs the next time slice of the hint job */
+    function step() {
+        var done = run(sliceTime);
+        if (!job.focused && hints.length) {
+            job.focused = true;
+            focusHint(0);
+        }
+        if (done) {
+            config.done(complete());
+        } else {
+            job.timer = window.setTimeout(step, 0);
+        }
+    }
 
-        if (count <= 1) {
-            return fire(0);
+    /* completes a running hint job at once */
+    function drain() {
+        if (job) {
+            window.clearTimeout(job.timer);
+            run(Infinity);
+            finish();
         }
-        return focusHint(0);
     }
 
-    function getOffsets(doc) {
-        var body  = doc.body || doc.documentElement,
-            style = body.style,
-            rect;
+    /* ends the hint job - the hints can only be narrowed by their */
+    /* captured text if all matching elements got a hint */
+    function finish() {
+        filter = job.count < config.maxHints ? job.filter : null;
+        job    = null;
+    }
+
+    function getLabelText(hint) {
+        return hint.title ? hint.num + ": " + hint.title.substr(0, 20) : String(hint.num);
+    }
+
+    /* creates the labels for the found elements at once */
+    function addLabels(d, found) {
+        var layer, fragment, label, box, hint, r, i;
+        if (!found.length) {
+            return;
+        }
+
+        layer    = getLayer(d);
+        fragment = document.createDocumentFragment();
+        for (i = 0; i < found.length; i++) {
+            hint = found[i];
+            r    = hint.rect;
+            job.count++;
+
+            /* the layer is placed over the viewport of the document, so */
+            /* the client rects can be used as they are */
+            box = overlay.box.cloneNode(false);
+            box.style.left   = r.left + "px";
+            box.style.top    = r.top + "px";
+            box.style.width  = r.width + "px";
+            box.style.height = r.height + "px";
+            fragment.appendChild(box);
+
+            /* create the hint label with number */
+            label = overlay.label.cloneNode(false);
+            label.style.left = Math.max(r.left, 0) + "px";
+            label.style.top  = Math.max(r.top, 0) + "px";
+            fragment.appendChild(label);
+
+            hints.push({
+                e:     hint.e,
+                num:   job.count,
+                label: label,
+                box:   box,
+                title: hint.label, /* image text shown in the label */
+                text:  hint.text   /* lowercase text the hint can be filtered by */
+            });
+            label.textContent = getLabelText(hints[hints.length - 1]);
+        }
+        layer.appendChild(fragment);
+    }
+
+    /* retrieves the layer of the overlay for the labels of the document - */
+    /* the layers of frames are nested into the layer of their parent */
+    /* document and clipped to the frames viewport */
+    function getLayer(d) {
+        var win = d.win, sx, sy, frame, layer;
+        if (d.layer) {
+            return d.layer;
+        }
+        if (!overlay) {
+            createOverlay();
+        }
+        if (!overlay.content) {
+            overlay.content = document.createElement("div");
+            overlay.root.appendChild(overlay.content);
+        }
+        if (!overlay.host.parentNode) {
+            document.documentElement.appendChild(overlay.host);
+        }
+
+        layer = document.createElement("div");
+        layer.style.position = "absolute";
+        if (d.parent) {
+            frame = document.createElement("div");
+            frame.style.cssText = "position:absolute;overflow:hidden;" +
+                "left:" + d.x + "px;top:" + d.y + "px;" +
+                "width:" + win.innerWidth + "px;height:" + win.innerHeight + "px";
+            frame.appendChild(layer);
+            getLayer(d.parent).appendChild(frame);
+        } else {
+            overlay.content.appendChild(layer);
+        }
+
+        /* move the labels along with the scrolled document instead of */
+        /* placing them into the document */
+        sx = win.scrollX;
+        sy = win.scrollY;
+        function scrolled() {
+            layer.style.webkitTransform = layer.style.transform =
+                "translate(" + (sx - win.scrollX) + "px," + (sy - win.scrollY) + "px)";
+        }
+        win.addEventListener("scroll", scrolled, false);
+        layers.push({win: win, scrolled: scrolled});
+
+        return (d.layer = layer);
+    }
+
+    /* creates the fixed overlay in the top document - the labels are */
+    /* isolated in a shadow root if this is supported, so that neither the */
+    /* page styles apply to them nor the page needs a new layout for them */
+    function createOverlay() {
+        var host = document.createElement("div"), root;
+
+        host.id            = cId;
+        host.style.cssText = "position:fixed;left:0;top:0;width:0;height:0;" +
+            "overflow:visible;z-index:2147483647;pointer-events:none";
 
-        if (style && /^(absolute|fixed|relative)$/.test(style.position)) {
-            rect = body.getClientRects()[0];
-            return [-rect.left, -rect.top];
+        if (host.attachShadow) {
+            root = host.attachShadow({mode: "closed"});
+        } else if (host.createShadowRoot) {
+            root = host.createShadowRoot();
+        } else if (host.webkitCreateShadowRoot) {
+            root = host.webkitCreateShadowRoot();
+        } else {
+            root = host;
         }
-        return [doc.defaultView.scrollX, doc.defaultView.scrollY];
+        createStyle(root === host ? document.head : root);
+
+        overlay = {
+            host:    host,
+            root:    root,
+            content: null,
+            label:   document.createElement("span"),
+            box:     document.createElement("div")
+        };
+        /* basic elements which will be cloned and updated later */
+        overlay.label.className = lClass;
+        overlay.box.className   = hClass;
     }
 
-    function createStyle(doc) {
-        if (doc.hasStyle) {
+    function isVisible(d, e, rect) {
+        var o = d.offsets;
+        if (!rect ||
+            rect.top > o.bottom || rect.bottom < o.top ||
+            rect.left > o.right || rect.right < o.left ||
+            !rect.width || !rect.height
+        ) {
+            return false;
+        }
+
+        var s = d.win.getComputedStyle(e, null);
+        return s.display !== "none" && s.visibility == "visible";
+    }
+
+    /* adds the style sheet for the overlay to given shadow root or head */
+    function createStyle(parent) {
+        if (parent.hasStyle) {
             return;
         }
-        var e = doc.createElement("style");
-        e.innerHTML += "." + lClass + "{" +
+        var e = document.createElement("style");
+        e.textContent = "." + lClass + "{" +
             "-webkit-transform:translate(-4px,-4px);" +
             "position:absolute;" +
-            "z-index:100000;" +
             "font-family:monospace;" +
             "font-weight:bold;" +
             "font-size:10px;" +
@@ -170,89 +623,141 @@ var VbHint = (function(){
             "opacity:0.7" +
             "}" +
             "." + hClass + "{" +
-            "background-color:#ff0 !important;" +
-            "color:#000 !important" +
+            "position:absolute;" +
+            "margin:0;" +
+            "padding:0;" +
+            "background-color:rgba(255,255,0,0.3)" +
             "}" +
             "." + hClass + "." + fClass + "{" +
-            "background-color:#8f0 !important" +
+            "background-color:rgba(136,255,0,0.4)" +
             "}" +
             "." + lClass + "." + fClass + "{" +
             "opacity:1" +
+            "}" +
+            "." + nClass + "{" +
+            "display:none" +
             "}";
 
-        doc.head.appendChild(e);
+        parent.appendChild(e);
         /* prevent us from adding the style multiple times */
-        doc.hasStyle = true;
+        parent.hasStyle = true;
     }
 
     function focus(back) {
+        drain();
         var n, i = ixdFocus;
         if (back) {
-            n = (i >= 1) ? i - 1 : hints.length - 1;
+            n = (i >= 1) ? i - 1 : shown.length - 1;
         } else {
-            n = (i + 1 < hints.length) ? i + 1 : 0;
+            n = (i + 1 < shown.length) ? i + 1 : 0;
         }
         return focusHint(n);
     }
 
+    /* shows only the hints with number prefix n or all hints if n is 0 */
     function update(n) {
-        var remove = [], idx, r, i, hint;
+        var show = [], focused, lo, hi, i, hint;
+        drain();
+
         if (n === 0) {
-            return create();
-        }
-        /* remove none matching hints */
-        for (i = 0; i < hints.length; ++i) {
-            hint = hints[i];
-            /* collect the hints to be removed */
-            if (0 !== hint.num.toString().indexOf(n.toString())) {
-                remove.push(hint);
+            show = hints;
+        } else {
+            /* the hints are numbered by their position, so the hints with */
+            /* the number prefix n are the ranges n, n0-n9, n00-n99 and so */
+            /* on, which can be taken without checking all the hints */
+            for (lo = n, hi = n; lo <= hints.length; lo *= 10, hi = hi * 10 + 9) {
+                for (i = lo; i <= hi && i <= hints.length; i++) {
+                    show.push(hints[i - 1]);
+                }
             }
         }
 
-        /* now remove the hints */
-        for (i = 0; i < remove.length; ++i) {
-            r = remove[i];
-            r.e.classList.remove(fClass);
-            r.e.classList.remove(hClass);
-            r.label.parentNode.removeChild(r.label);
-
-            /* remove hints from all hints */
-            if ((idx = hints.indexOf(r)) !== -1) {
-                hints.splice(idx, 1);
+        /* only the hints that change their state are touched and all the */
+        /* changes are written without reading the layout in between */
+        updates++;
+        for (i = 0; i < show.length; i++) {
+            hint = show[i];
+            hint.update = updates;
+            if (hint.hidden) {
+                setHidden(hint, false);
+            }
+        }
+        for (i = 0; i < shown.length; i++) {
+            hint = shown[i];
+            if (hint.update !== updates) {
+                setHidden(hint, true);
             }
         }
 
+        focused  = getHint(ixdFocus);
+        shown    = show;
+        ixdFocus = Math.max(shown.indexOf(focused), 0);
 
-        if (hints.length === 1) {
+        if (shown.length === 1) {
             return fire(0);
         }
         return focusHint(0);
     }
 
+    function setHidden(hint, hide) {
+        hint.hidden = hide;
+        if (hide) {
+            hint.box.classList.remove(fClass);
+            hint.box.classList.add(nClass);
+            hint.label.classList.remove(fClass);
+            hint.label.classList.add(nClass);
+        } else {
+            hint.box.classList.remove(nClass);
+            hint.label.classList.remove(nClass);
+        }
+    }
+
     function clear() {
-        var i, hint;
-        if (hints.length === 0) {
-            return;
+        var i;
+        if (job) {
+            window.clearTimeout(job.timer);
+            job = null;
         }
-        for (i = 0; i < hints.length; ++i) {
-            hint = hints[i];
-            if (hint.e) {
-                hint.e.classList.remove(fClass);
-                hint.e.classList.remove(hClass);
-                hint.label.parentNode.removeChild(hint.label);
+        filter = null;
+        hints  = shown = [];
+        for (i = 0; i < layers.length; ++i) {
+            layers[i].win.removeEventListener("scroll", layers[i].scrolled, false);
+        }
+        layers = [];
+        /* the labels are removed together with their layers, the page */
+        /* elements are not touched at all */
+        if (overlay && overlay.content) {
+            overlay.root.removeChild(overlay.content);
+            overlay.content = null;
+            if (overlay.host.parentNode) {
+                overlay.host.parentNode.removeChild(overlay.host);
             }
         }
-        hints = [];
-        for (i = 0; i < hConts.length; ++i) {
-            hConts[i].parentNode.removeChild(hConts[i]);
+    }
+
+    /* stops observing the document and drops its candidate cache - the */
+    /* marks are reset for the case the document is restored from the page */
+    /* cache */
+    function dropCache(doc) {
+        var cache = doc.vbHintCache, c, m, i;
+        if (!cache) {
+            return;
+        }
+        cache.observer.disconnect();
+        for (m in cache.modes) {
+            c = cache.modes[m];
+            for (i = 0; i < c.list.length; i++) {
+                c.list[i][c.mark] = false;
+            }
         }
-        hConts = [];
+        doc.vbHintCache = null;
     }
 
     function fire(i) {
+        drain();
         var hint = getHint(i || ixdFocus);
         if (!hint) {
-            return "DONE:";
+            return result(DONE);
         }
 
         var e    = hint.e,
@@ -265,24 +770,24 @@ var VbHint = (function(){
             if (type === "radio" || type === "checkbox") {
                 e.focus();
                 click(e);
-                return "DONE:";
+                return result(DONE);
             }
             if (type === "submit" || type === "reset" || type  === "button" || type === "image") {
                 click(e);
-                return "DONE:";
+                return result(DONE);
             }
             e.focus();
-            return "INSERT:";
+            return result(INSERT);
         }
         if (tag === "iframe" || tag === "frame") {
             e.focus();
-            return "DONE:";
+            return result(DONE);
         }
 
         switch (config.usage) {
-            case "T": open(e, true); return "DONE:";
-            case "O": open(e, false); return "DONE:";
-            default: return "DATA:" + getSrc(e);
+            case "T": open(e, true); return result(DONE);
+            case "O": open(e, false); return result(DONE);
+            default: return result(DATA, getSrc(e));
         }
     }
 
@@ -304,7 +809,7 @@ var VbHint = (function(){
         /* reset previous focused hint */
         var hint;
         if ((hint = getHint(ixdFocus))) {
-            hint.e.classList.remove(fClass);
+            hint.box.classList.remove(fClass);
             hint.label.classList.remove(fClass);
 
             mouseEvent(hint.e, "mouseout");
@@ -313,19 +818,18 @@ var VbHint = (function(){
         /* mark new hint as focused */
         ixdFocus = i;
         if ((hint = getHint(i))) {
-            hint.e.classList.add(fClass);
+            hint.box.classList.add(fClass);
             hint.label.classList.add(fClass);
 
             mouseEvent(hint.e, "mouseover");
 
-            var src = getSrc(hint.e);
-            return "OVER:" + (src || "");
+            return result(OVER, getSrc(hint.e));
         }
     }
 
     /* retrieves the hint for given hint number */
     function getHint(i) {
-        return hints[i] || null;
+        return shown[i] || null;
     }
 
     function click(e) {
@@ -346,111 +850,208 @@ var VbHint = (function(){
         return e.href || e.src;
     }
 
-    /* retrieves the xpath expression according to mode */
-    function getXpath(s) {
-        if (s === undefined) {
-            s = "";
-        }
-        /* replace $WHAT in xpath to contains(translate(WHAT, 'SEARCH', 'search'), 'search') */
-        function buildQuery(what, x, s) {
-            var l, i, parts;
-            l = s.toLowerCase();
-            parts = [
-                "contains(translate(",
-                ",'"+s.toUpperCase()+"','"+l+"'),'"+l+"')"
-            ];
-            for (i = 0; i < what.length; ++i) {
-                x = x.split("$" + what[i]).join(parts.join(what[i]));
+    /* retrieves the functions to check if an element is a candidate of */
+    /* the current hint mode and to get the lowercase text the candidate */
+    /* can be filtered by - the texts are joined by newlines which can't be */
+    /* part of the filter text */
+    function getMatcher() {
+        function attr(e, name) {
+            return e.getAttribute(name) || "";
+        }
+        function editable(e) {
+            return !e.hasAttribute("disabled") && !e.hasAttribute("readonly");
+        }
+        function clickable(e) {
+            var role = e.getAttribute("role");
+            return e.hasAttribute("onclick") || e.classList.contains("lk") ||
+                role === "link" || role === "button";
+        }
+        function input(e) {
+            return e.localName === "input" && e.getAttribute("type") !== "hidden" && editable(e);
+        }
+        /* elements that can be filtered by their text content */
+        function texted(e) {
+            switch (e.localName) {
+                case "textarea":
+                    return editable(e);
+                case "button":
+                case "select":
+                    return true;
             }
-            return x;
+            return e.hasAttribute("href") || clickable(e);
         }
 
         switch (config.mode) {
             case "l":
-                if (!s) {
-                    return "//*[@href] | //*[@onclick or @tabindex or @class='lk' or @role='link' or @role='button'] | //input[not(@type='hidden' or @disabled or @readonly)] | //textarea[not(@disabled or @readonly)] | //button | //select";
-                }
-                return buildQuery(
-                    ["@value", ".", "@placeholder", "@title", "@alt"],
-                    "//*[@href and ($. or child::img[$@title or $@alt])] | //*[(@onclick or @class='lk' or @role='link' or role='button') and $.] | //input[not(@type='hidden' or @disabled or @readonly) and ($@value or $@placeholder)] | //textarea[not(@disabled or @readonly) and $.] | //button[$.] | //select[$.]",
-                    s
-                );
+                return {
+                    candidate: function (e) {
+                        /* elements with tabindex only are hinted without */
+                        /* filter text, they have no text to filter by */
+                        return texted(e) || input(e) || e.hasAttribute("tabindex");
+                    },
+                    text: function (e) {
+                        var t = [], c;
+                        if (texted(e)) {
+                            t.push(e.textContent);
+                        }
+                        if (e.hasAttribute("href")) {
+                            /* match also the title or alt of child images */
+                            for (c = e.firstElementChild; c; c = c.nextElementSibling) {
+                                if (c.localName === "img") {
+                                    t.push(attr(c, "title"), attr(c, "alt"));
+                                }
+                            }
+                        }
+                        if (input(e)) {
+                            t.push(attr(e, "value"), attr(e, "placeholder"));
+                        }
+                        return t.join("\n").toLowerCase();
+                    }
+                };
             case "e":
-                if (!s) {
-                    return "//input[not(@type) or @type='text'] | //textarea";
-                }
-                return buildQuery(
-                    ["@value", ".", "@placeholder"],
-                    "//input[(not(@type) or @type='text') and ($@value or $@placeholder)] | //textarea[$.]",
-                    s
-                );
+                return {
+                    candidate: function (e) {
+                        var type;
+                        if (e.localName === "input") {
+                            type = e.getAttribute("type");
+                            return type === null || type === "text";
+                        }
+                        return e.localName === "textarea";
+                    },
+                    text: function (e) {
+                        if (e.localName === "input") {
+                            return (attr(e, "value") + "\n" + attr(e, "placeholder")).toLowerCase();
+                        }
+                        return e.textContent.toLowerCase();
+                    }
+                };
             case "i":
-                if (!s) {
-                    return "//img[@src]";
-                }
-                return buildQuery(["@title", "@alt"], "//img[@src and ($@title or $@alt)]", s);
+                return {
+                    candidate: function (e) {
+                        return e.localName === "img" && e.hasAttribute("src");
+                    },
+                    text: function (e) {
+                        return (attr(e, "title") + "\n" + attr(e, "alt")).toLowerCase();
+                    }
+                };
         }
+        return {
+            candidate: function (e) {return false;},
+            text:      function (e) {return "";}
+        };
     }
 
     /* follow the count last link on pagematching the given pattern */
-    function followLink(rel, pattern, count) {
-        /* returns array of matching elements */
-        function followFrame(frame) {
-            var i, p, reg, res = [],
-                doc = frame.document,
-                elems = [],
+    function followLink(rel, patterns, count) {
+        var pattern = getPatterns(patterns), seen = [], i, j, doc, res, e;
+
+        /* retrieves true if the rel attribute of e contains rel */
+        function hasRel(e) {
+            var r = (e.getAttribute("rel") || "").toLowerCase().split(/\s+/);
+            return r.indexOf(rel) !== -1 || (rel === "prev" && r.indexOf("previous") !== -1);
+        }
+        /* returns array of matching links without checking the visibility */
+        function followFrame(doc) {
+            var i, p, reg, res = [], elems = [], texts = [],
                 all = doc.getElementsByTagName("a");
 
             /* first match links by rel attribute */
             for (i = all.length - 1; i >= 0; i--) {
-                /* collect visible elements */
-                var s = doc.defaultView.getComputedStyle(all[i], null);
-                if (s.display !== "none" && s.visibility === "visible") {
-                    /* if there are rel attributes alaments, put them in the result */
-                    if (all[i].rel.toLowerCase() === rel) {
-                        res.push(all[i]);
-                    } else {
-                        /* save to match them later */
-                        elems.push(all[i]);
-                    }
+                if (hasRel(all[i])) {
+                    res.push(all[i]);
+                } else {
+                    /* save to match them later - the text content does not */
+                    /* need the layout of the page like innerText - the space */
+                    /* is escaped because js2h.sh strips spaces around quotes */
+                    elems.push(all[i]);
+                    texts.push(all[i].textContent.replace(/\s+/g, "\u0020").trim());
                 }
             }
             /* match each pattern successively against each link in the page */
+            /* begining with the last link */
             for (p = 0; p < pattern.length; p++) {
                 reg = pattern[p];
-                /* begin with the last link on page */
-                for (i = elems.length - 1; i >= 0; i--) {
-                    if (elems[i].innerText.match(reg)) {
+                for (i = 0; i < elems.length; i++) {
+                    if (reg.test(texts[i])) {
                         res.push(elems[i]);
                     }
                 }
             }
             return res;
         }
-        var i, j, elems, frames = allFrames(window);
+
+        var frames = allFrames(window);
+        /* the links of the document head are the most reliable source */
+        for (i = 0; i < frames.length; i++) {
+            doc = frames[i].document;
+            res = doc ? doc.querySelectorAll("link[rel]") : [];
+            for (j = 0; j < res.length; j++) {
+                if (res[j].href && hasRel(res[j]) && --count === 0) {
+                    frames[i].location.href = res[j].href;
+                    return result(DONE);
+                }
+            }
+        }
         for (i = 0; i < frames.length; i++) {
-            elems = followFrame(frames[i]);
-            for (j = 0; j < elems.length; j++) {
-                if (--count == 0) {
-                    open(elems[j], false);
-                    return "DONE:";
+            doc = frames[i].document;
+            if (!doc) {
+                continue;
+            }
+            res = followFrame(doc);
+            for (j = 0; j < res.length; j++) {
+                e = res[j];
+                /* links matching multiple patterns are counted once and the */
+                /* visibility is only checked for the matching links */
+                if (seen.indexOf(e) !== -1 || !isDisplayed(frames[i], e)) {
+                    continue;
+                }
+                seen.push(e);
+                if (--count === 0) {
+                    open(e, false);
+                    return result(DONE);
                 }
             }
         }
-        return "NONE:";
+        return result(NONE);
+    }
+
+    /* retrieves the compiled list of regex literals given as string - the */
+    /* lists are compiled only once per pattern setting - the global flag is */
+    /* dropped because test() of a reused global regex continues at the */
+    /* lastIndex of the previous match */
+    function getPatterns(patterns) {
+        var list, r, i;
+        if (!compiled.hasOwnProperty(patterns)) {
+            list = (new Function("return [" + patterns + "];"))();
+            for (i = 0; i < list.length; i++) {
+                r = list[i];
+                if (r instanceof RegExp && r.global) {
+                    list[i] = new RegExp(r.source, (r.ignoreCase ? "i" : "") + (r.multiline ? "m" : ""));
+                }
+            }
+            compiled[patterns] = list;
+        }
+        return compiled[patterns];
+    }
+
+    function isDisplayed(win, e) {
+        var s = win.getComputedStyle(e, null);
+        return s.display !== "none" && s.visibility === "visible";
     }
 
     function allFrames(win) {
-        var i, f, frames = [win];
+        var i, frames = [win];
         for (i = 0; i < win.frames.length; i++) {
-            frames.push(win.frames[i].frameElement);
+            frames.push(win.frames[i]);
         }
         return frames;
     }
 
     /* the api */
     return {
-        init: function init(prefix, maxHints) {
+        /* done is called with the result of hint creation that is */
+        /* completed in the background */
+        init: function init(prefix, maxHints, rapid, done) {
             /* mode: l - links, i - images, e - editables */
             /* usage: O - open, T - open in new window, U - use source */
             var map = {
@@ -471,13 +1072,19 @@ var VbHint = (function(){
             config = {
                 mode:     'l',
                 usage:    'O',
-                maxHints: maxHints
+                maxHints: maxHints,
+                done:     done
             };
             /* overwrite with mapped config if found */
             if (map.hasOwnProperty(prefix)) {
                 config.mode  = map[prefix][0];
                 config.usage = map[prefix][1];
             }
+            /* in rapid mode the sources are collected and used together */
+            if (rapid) {
+                config.usage = 'U';
+                config.rapid = true;
+            }
         },
         create:     create,
         update:     update,
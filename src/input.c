@@ -42,6 +42,7 @@ void input_enter(void)
     /* switch focus first to make shure we can write to the inputbox without
      * disturbing the user */
     gtk_widget_grab_focus(GTK_WIDGET(vb.gui.webview));
+    vb.mode->flags |= FLAG_PASSTHROUGH;
     vb_echo(VB_MSG_NORMAL, false, "-- INPUT --");
 }
 
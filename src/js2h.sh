@@ -1,7 +1,9 @@
 #!/bin/sh
+# Minifies the javascript read from stdin and writes it as C string define
+# with the name given as first argument.
 
-echo -n '#define HINTS_JS "'
-cat $1 | \
+echo -n "#define $1 \""
+cat | \
     tr '\n\r\t' ' ' | \
     sed -e 's:/\*[^*]*\*/::g' \
     -e 's|[ ]\{2,\}| |g' \
@@ -0,0 +1,217 @@
+/**
+ * vimb - a webkit based vim like browser.
+ *
+ * Copyright (C) 2012-2013 Daniel Carl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+/**
+ * Latency histograms of the key handling. The measured times are sorted into
+ * log-linear buckets like HDR histograms do. Times below SUB_COUNT usec get
+ * an exact bucket, above each power of two range is split into HALF_COUNT
+ * buckets, so that the relative error stays below 1/HALF_COUNT for all
+ * values.
+ */
+#include "config.h"
+#include "main.h"
+#include "keystats.h"
+
+#ifdef FEATURE_KEYSTATS
+
+#define SUB_BITS    5
+#define SUB_COUNT   (1 << SUB_BITS)
+#define HALF_COUNT  (SUB_COUNT / 2)
+/* number of power of two ranges above SUB_COUNT - larger values are counted
+ * in the last bucket */
+#define MAX_SHIFT   23
+#define MAX_VALUE   (((gint64)SUB_COUNT << MAX_SHIFT) - 1)
+#define BUCKETS     (SUB_COUNT + MAX_SHIFT * HALF_COUNT)
+
+typedef struct {
+    guint64 count[KEYSTATS_LAST];
+    gint64  max[KEYSTATS_LAST];
+    guint32 buckets[KEYSTATS_LAST][BUCKETS];
+} ModeStats;
+
+static int bucket_index(gint64 usec);
+static gint64 bucket_value(int idx);
+static gint64 percentile(const ModeStats *ms, KeyStatsStage stage, double p);
+
+/* stats by mode id - allocated on first use */
+static struct {
+    ModeStats *modes[128];
+} keystats;
+
+static const char *stage_names[KEYSTATS_LAST] = {"key", "map", "mode"};
+
+
+void keystats_cleanup(void)
+{
+    for (int i = 0; i < LENGTH(keystats.modes); i++) {
+        g_free(keystats.modes[i]);
+        keystats.modes[i] = NULL;
+    }
+}
+
+/**
+ * Adds the duration usec of given stage to the histogram of the mode.
+ */
+void keystats_add(char mode, KeyStatsStage stage, gint64 usec)
+{
+    ModeStats *ms;
+
+    if ((guchar)mode >= LENGTH(keystats.modes)) {
+        return;
+    }
+    if (!(ms = keystats.modes[(guchar)mode])) {
+        ms = keystats.modes[(guchar)mode] = g_new0(ModeStats, 1);
+    }
+
+    ms->buckets[stage][bucket_index(usec)]++;
+    ms->count[stage]++;
+    if (usec > ms->max[stage]) {
+        ms->max[stage] = usec;
+    }
+}
+
+/**
+ * Retrieves a table with the percentiles of all measured modes and stages.
+ *
+ * Returned string must be freed.
+ */
+char *keystats_summary(void)
+{
+    GString *str = g_string_new("mode stage      count      p50      p90      p99      max (usec)");
+    ModeStats *ms;
+
+    for (int m = 0; m < LENGTH(keystats.modes); m++) {
+        if (!(ms = keystats.modes[m])) {
+            continue;
+        }
+        for (int s = 0; s < KEYSTATS_LAST; s++) {
+            if (!ms->count[s]) {
+                continue;
+            }
+            g_string_append_printf(
+                str, "\n%-4c %-5s %10" G_GUINT64_FORMAT " %8" G_GINT64_FORMAT
+                " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT,
+                m, stage_names[s], ms->count[s],
+                percentile(ms, s, 50), percentile(ms, s, 90),
+                percentile(ms, s, 99), ms->max[s]
+            );
+        }
+    }
+
+    return g_string_free(str, false);
+}
+
+/**
+ * Writes the full histograms of all modes and stages into given file. For
+ * each used bucket the highest value of the bucket, the number of measured
+ * times in it and the fraction of all times up to that bucket is written.
+ */
+gboolean keystats_write(const char *file)
+{
+    GString *str = g_string_new(NULL);
+    ModeStats *ms;
+    guint64 sum;
+    gboolean success;
+
+    for (int m = 0; m < LENGTH(keystats.modes); m++) {
+        if (!(ms = keystats.modes[m])) {
+            continue;
+        }
+        for (int s = 0; s < KEYSTATS_LAST; s++) {
+            if (!ms->count[s]) {
+                continue;
+            }
+            g_string_append_printf(
+                str, "# mode %c stage %s count %" G_GUINT64_FORMAT " max %" G_GINT64_FORMAT "\n"
+                "#      value      count percentile\n",
+                m, stage_names[s], ms->count[s], ms->max[s]
+            );
+            sum = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                if (!ms->buckets[s][i]) {
+                    continue;
+                }
+                sum += ms->buckets[s][i];
+                g_string_append_printf(
+                    str, "%12" G_GINT64_FORMAT " %10u %10.6f\n",
+                    MIN(bucket_value(i), ms->max[s]), ms->buckets[s][i],
+                    (double)sum / ms->count[s]
+                );
+            }
+            g_string_append_c(str, '\n');
+        }
+    }
+
+    success = g_file_set_contents(file, str->str, str->len, NULL);
+    g_string_free(str, true);
+
+    return success;
+}
+
+static int bucket_index(gint64 usec)
+{
+    int shift;
+
+    if (usec < SUB_COUNT) {
+        return usec < 0 ? 0 : (int)usec;
+    }
+    if (usec > MAX_VALUE) {
+        return BUCKETS - 1;
+    }
+    /* shift the value so that it fits into the upper half of the sub range */
+    shift = g_bit_storage((gulong)usec) - SUB_BITS;
+
+    return SUB_COUNT + (shift - 1) * HALF_COUNT + (int)(usec >> shift) - HALF_COUNT;
+}
+
+/**
+ * Retrieves the highest value that is counted in the bucket of given index.
+ */
+static gint64 bucket_value(int idx)
+{
+    int shift, sub;
+
+    if (idx < SUB_COUNT) {
+        return idx;
+    }
+    shift = (idx - SUB_COUNT) / HALF_COUNT + 1;
+    sub   = (idx - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+
+    return ((gint64)(sub + 1) << shift) - 1;
+}
+
+static gint64 percentile(const ModeStats *ms, KeyStatsStage stage, double p)
+{
+    guint64 target, sum = 0;
+
+    target = (guint64)(ms->count[stage] * p / 100.0 + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+    for (int i = 0; i < BUCKETS; i++) {
+        sum += ms->buckets[stage][i];
+        if (sum >= target) {
+            return MIN(bucket_value(i), ms->max[stage]);
+        }
+    }
+
+    return ms->max[stage];
+}
+
+#endif /* FEATURE_KEYSTATS */
@@ -0,0 +1,51 @@
+/**
+ * vimb - a webkit based vim like browser.
+ *
+ * Copyright (C) 2012-2013 Daniel Carl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef _KEYSTATS_H
+#define _KEYSTATS_H
+
+#include "config.h"
+#include "main.h"
+
+typedef enum {
+    KEYSTATS_KEY,   /* whole key event handling in map_keypress() */
+    KEYSTATS_MAP,   /* processing of the key queue in map_handle_keys() */
+    KEYSTATS_MODE,  /* keypress function of the mode */
+    KEYSTATS_LAST
+} KeyStatsStage;
+
+#ifdef FEATURE_KEYSTATS
+/* take the start time of a measured stage and the mode to account the time
+ * for into variables named by t */
+#define KEYSTATS_START(t, mode) \
+    gint64 t = g_get_monotonic_time(); char t##_mode = (mode)
+/* add the time elapsed since KEYSTATS_START to the stats */
+#define KEYSTATS_STOP(t, stage) \
+    keystats_add(t##_mode, stage, g_get_monotonic_time() - t)
+
+void keystats_cleanup(void);
+void keystats_add(char mode, KeyStatsStage stage, gint64 usec);
+char *keystats_summary(void);
+gboolean keystats_write(const char *file);
+#else
+#define KEYSTATS_START(t, mode)
+#define KEYSTATS_STOP(t, stage)
+#endif
+
+#endif /* end of include guard: _KEYSTATS_H */
@@ -38,11 +38,27 @@
 #include "default.h"
 #include "pass.h"
 #include "bookmark.h"
+#include "keystats.h"
+#include "fulltext.h"
 
 /* variables */
 static char **args;
 VbCore      vb;
 
+/* parts of the gui that are redrawn on the next run of render_gui() */
+#define UPDATE_STATUSBAR 0x01
+#define UPDATE_URLBAR    0x02
+#define UPDATE_TITLE     0x04
+
+static struct {
+    int   dirty;    /* parts to redraw */
+    guint source;   /* id of the idle source running render_gui() */
+    char  *status;  /* last shown texts to skip unchanged updates */
+    char  *url;
+    char  *title;
+    char  *link;    /* hovered link to show instead of the url */
+} gui_update;
+
 /* callbacks */
 static void webview_progress_cb(WebKitWebView *view, GParamSpec *pspec);
 static void webview_download_progress_cb(WebKitWebView *view, GParamSpec *pspec);
@@ -68,8 +84,13 @@ static void download_progress_cp(WebKitDownload *download, GParamSpec *pspec);
 
 /* functions */
 static void update_title(void);
+static void update_gui(int parts);
+static gboolean render_gui(gpointer data);
+static void render_statusbar(void);
+static void render_urlbar(void);
+static void render_title(void);
+static void set_label_text(GtkWidget *label, char **last, char *text);
 static void run_user_script(WebKitWebFrame *frame);
-static char *jsref_to_string(JSContextRef context, JSValueRef ref);
 static void init_core(void);
 static void read_config(void);
 static void setup_signals();
@@ -158,14 +179,31 @@ gboolean vb_eval_script(WebKitWebFrame *frame, char *script, char *file, char **
     JSStringRelease(str);
 
     if (result) {
-        *value = jsref_to_string(js, result);
+        *value = vb_jsref_to_string(js, result);
         return true;
     }
 
-    *value = jsref_to_string(js, exception);
+    *value = vb_jsref_to_string(js, exception);
     return false;
 }
 
+/**
+ * Retrieves the string representation of given javascript value.
+ * Returned string must be freed with g_free.
+ */
+char *vb_jsref_to_string(JSContextRef context, JSValueRef ref)
+{
+    char *string;
+    JSStringRef str_ref = JSValueToStringCopy(context, ref, NULL);
+    size_t len          = JSStringGetMaximumUTF8CStringSize(str_ref);
+
+    string = g_new0(char, len);
+    JSStringGetUTF8CString(str_ref, string, len);
+    JSStringRelease(str_ref);
+
+    return string;
+}
+
 gboolean vb_load_uri(const Arg *arg)
 {
     char *uri = NULL, *rp, *path = NULL;
@@ -254,7 +292,16 @@ void vb_set_widget_font(GtkWidget *widget, const VbColor *fg, const VbColor *bg,
     VB_WIDGET_OVERRIDE_BACKGROUND(widget, VB_GTK_STATE_NORMAL, bg);
 }
 
+/**
+ * Marks the statusbar to be updated. The update is delayed until the main
+ * loop is idle, so that many changes in a row lead to only one update.
+ */
 void vb_update_statusbar()
+{
+    update_gui(UPDATE_STATUSBAR);
+}
+
+static void render_statusbar(void)
 {
     int max, val, num;
     GString *status = g_string_new("");
@@ -265,6 +312,11 @@ void vb_update_statusbar()
         g_string_append_printf(status, " %d %s", num, num == 1 ? "download" : "downloads");
     }
 
+    /* show the search match counter */
+    if (vb.state.search_count) {
+        g_string_append_printf(status, " match %u/%u", vb.state.search_index, vb.state.search_count);
+    }
+
     /* show load status of page or the downloads */
     if (vb.state.progress != 100) {
         g_string_append_printf(status, " [%i%%]", vb.state.progress);
@@ -284,8 +336,7 @@ void vb_update_statusbar()
         g_string_append_printf(status, " %d%%", val);
     }
 
-    gtk_label_set_text(GTK_LABEL(vb.gui.statusbar.right), status->str);
-    g_string_free(status, true);
+    set_label_text(vb.gui.statusbar.right, &gui_update.status, g_string_free(status, false));
 }
 
 void vb_update_status_style(void)
@@ -313,27 +364,46 @@ void vb_update_input_style(void)
     );
 }
 
-void vb_update_urlbar(const char *uri)
+/**
+ * Marks the url in statusbar to be updated on next idle.
+ */
+void vb_update_urlbar(void)
+{
+    update_gui(UPDATE_URLBAR);
+}
+
+static void render_urlbar(void)
 {
     Gui *gui = &vb.gui;
+    const char *uri;
 #ifdef FEATURE_HISTORY_INDICATOR
     gboolean back, fwd;
-    char *str;
+#endif
 
+    /* a hovered link is shown instead of the url */
+    if (gui_update.link) {
+        set_label_text(gui->statusbar.left, &gui_update.url, g_strconcat("Link: ", gui_update.link, NULL));
+        return;
+    }
+
+    uri = GET_URI();
+    if (!uri) {
+        uri = "";
+    }
+#ifdef FEATURE_HISTORY_INDICATOR
     back = webkit_web_view_can_go_back(gui->webview);
     fwd  = webkit_web_view_can_go_forward(gui->webview);
 
     /* show history indicator only if there is something to show */
     if (back || fwd) {
-        str = g_strdup_printf("%s [%s]", uri, back ? (fwd ? "-+" : "-") : "+");
-        gtk_label_set_text(GTK_LABEL(gui->statusbar.left), str);
-        g_free(str);
-    } else {
-        gtk_label_set_text(GTK_LABEL(gui->statusbar.left), uri);
+        set_label_text(
+            gui->statusbar.left, &gui_update.url,
+            g_strdup_printf("%s [%s]", uri, back ? (fwd ? "-+" : "-") : "+")
+        );
+        return;
     }
-#else
-    gtk_label_set_text(GTK_LABEL(gui->statusbar.left), uri);
 #endif
+    set_label_text(gui->statusbar.left, &gui_update.url, g_strdup(uri));
 }
 
 void vb_quit(void)
@@ -345,19 +415,37 @@ void vb_quit(void)
     }
 
     completion_clean();
+    ex_cleanup();
 
     webkit_web_view_stop_loading(vb.gui.webview);
 
+    hints_cleanup();
+    dom_clear_index();
     map_cleanup();
     mode_cleanup();
+#ifdef FEATURE_KEYSTATS
+    keystats_cleanup();
+#endif
     setting_cleanup();
     shortcut_cleanup();
     history_cleanup();
+#ifdef FEATURE_FULLTEXT
+    fulltext_cleanup();
+#endif
 
     for (int i = 0; i < FILES_LAST; i++) {
         g_free(vb.files[i]);
     }
 
+    if (gui_update.source) {
+        g_source_remove(gui_update.source);
+        gui_update.source = 0;
+    }
+    g_free(gui_update.status);
+    g_free(gui_update.url);
+    g_free(gui_update.title);
+    g_free(gui_update.link);
+
     gtk_main_quit();
 }
 
@@ -420,6 +508,12 @@ static void webview_load_status_cb(WebKitWebView *view, GParamSpec *pspec)
                 /* inject the hinting javascript */
                 hints_init(frame);
 
+                /* the editable elements belong to the previous page */
+                dom_clear_index();
+
+                /* the matches of the search belong to the previous page */
+                vb.state.search_index = vb.state.search_count = 0;
+
                 /* run user script file */
                 run_user_script(frame);
             }
@@ -430,7 +524,7 @@ static void webview_load_status_cb(WebKitWebView *view, GParamSpec *pspec)
             }
 
             vb_update_statusbar();
-            vb_update_urlbar(uri);
+            vb_update_urlbar();
 
             break;
 
@@ -446,6 +540,9 @@ static void webview_load_status_cb(WebKitWebView *view, GParamSpec *pspec)
             if (strncmp(uri, "about:", 6)) {
                 dom_check_auto_insert(view);
                 history_add(HISTORY_URL, uri, webkit_web_view_get_title(view));
+#ifdef FEATURE_FULLTEXT
+                fulltext_add(view);
+#endif
             }
             break;
 
@@ -539,19 +636,6 @@ static void run_user_script(WebKitWebFrame *frame)
     }
 }
 
-static char *jsref_to_string(JSContextRef context, JSValueRef ref)
-{
-    char *string;
-    JSStringRef str_ref = JSValueToStringCopy(context, ref, NULL);
-    size_t len          = JSStringGetMaximumUTF8CStringSize(str_ref);
-
-    string = g_new0(char, len);
-    JSStringGetUTF8CString(str_ref, string, len);
-    JSStringRelease(str_ref);
-
-    return string;
-}
-
 static void init_core(void)
 {
     Gui *gui = &vb.gui;
@@ -647,6 +731,9 @@ static void init_core(void)
     mode_add('p', pass_enter, pass_leave, pass_keypress, NULL);
 
     init_files();
+#ifdef FEATURE_FULLTEXT
+    fulltext_init();
+#endif
     session_init();
     setting_init();
     shortcut_init();
@@ -667,11 +754,30 @@ static void init_core(void)
 static void read_config(void)
 {
     char *line, **lines;
+    gboolean valid = true;
+    guint seed = 0;
+
+    /* the default config is part of the binary, so it identifies the build
+     * the config cache was written by */
+    for (guint i = 0; default_config[i] != NULL; i++) {
+        seed = seed * 31 + g_str_hash(default_config[i]);
+    }
+
+    /* collect all webkit settings to apply them with a single update */
+    setting_transaction_begin();
+
+    /* apply the already parsed config if the config file was not changed */
+    if (setting_cache_load(vb.files[FILES_CONFIG_CACHE], vb.files[FILES_CONFIG], seed)) {
+        setting_transaction_commit();
+        return;
+    }
+    setting_cache_start();
 
     /* load default config */
     for (guint i = 0; default_config[i] != NULL; i++) {
         if (!ex_run_string(default_config[i])) {
             fprintf(stderr, "Invalid default config: %s\n", default_config[i]);
+            valid = false;
         }
     }
 
@@ -687,10 +793,16 @@ static void read_config(void)
             }
             if (!ex_run_string(line)) {
                 fprintf(stderr, "Invalid config: %s\n", line);
+                valid = false;
             }
         }
     }
     g_strfreev(lines);
+
+    /* write the cache only for a valid config to get the errors reported on
+     * next startup again */
+    setting_cache_stop(vb.files[FILES_CONFIG_CACHE], vb.files[FILES_CONFIG], seed, valid);
+    setting_transaction_commit();
 }
 
 static void setup_signals()
@@ -760,6 +872,18 @@ static void init_files(void)
         util_create_file_if_not_exists(vb.files[FILES_CONFIG]);
     }
 
+    if (vb.files[FILES_CONFIG]) {
+        /* use own cache file for each config file */
+        char *cache = util_get_cache_dir();
+        char *sum   = g_compute_checksum_for_string(G_CHECKSUM_MD5, vb.files[FILES_CONFIG], -1);
+        char *name  = g_strconcat("config-", sum, NULL);
+
+        vb.files[FILES_CONFIG_CACHE] = g_build_filename(cache, name, NULL);
+        g_free(name);
+        g_free(sum);
+        g_free(cache);
+    }
+
 #ifdef FEATURE_COOKIE
     vb.files[FILES_COOKIE] = g_build_filename(path, "cookies", NULL);
     util_create_file_if_not_exists(vb.files[FILES_COOKIE]);
@@ -785,6 +909,11 @@ static void init_files(void)
     util_create_file_if_not_exists(vb.files[FILES_QUEUE]);
 #endif
 
+#ifdef FEATURE_FULLTEXT
+    vb.files[FILES_FULLTEXT]     = g_build_filename(path, "fulltext", NULL);
+    vb.files[FILES_FULLTEXT_LOG] = g_build_filename(path, "fulltext.log", NULL);
+#endif
+
     vb.files[FILES_SCRIPT] = g_build_filename(path, "scripts.js", NULL);
 
     vb.files[FILES_USER_STYLE] = g_build_filename(path, "style.css", NULL);
@@ -851,14 +980,8 @@ static void create_web_view_received_uri_cb(WebKitWebView *view)
 
 static void hover_link_cb(WebKitWebView *webview, const char *title, const char *link)
 {
-    char *message;
-    if (link) {
-        message = g_strconcat("Link: ", link, NULL);
-        gtk_label_set_text(GTK_LABEL(vb.gui.statusbar.left), message);
-        g_free(message);
-    } else {
-        vb_update_urlbar(webkit_web_view_get_uri(webview));
-    }
+    OVERWRITE_STRING(gui_update.link, link);
+    vb_update_urlbar();
 }
 
 static void title_changed_cb(WebKitWebView *webview, WebKitWebFrame *frame, const char *title)
@@ -869,22 +992,86 @@ static void title_changed_cb(WebKitWebView *webview, WebKitWebFrame *frame, cons
 
 static void update_title(void)
 {
+    update_gui(UPDATE_TITLE);
+}
+
+/**
+ * Marks given parts of the gui to be redrawn and schedules the redraw for
+ * the next time the main loop is idle. The priority is a little higher than
+ * that of gtk's redraw, so that the changes are drawn in the same frame.
+ */
+static void update_gui(int parts)
+{
+    gui_update.dirty |= parts;
+    if (!gui_update.source) {
+        gui_update.source = g_idle_add_full(GDK_PRIORITY_REDRAW - 1, render_gui, NULL, NULL);
+    }
+}
+
+static gboolean render_gui(gpointer data)
+{
+    int dirty = gui_update.dirty;
+
+    gui_update.dirty  = 0;
+    gui_update.source = 0;
+
+    if (dirty & UPDATE_STATUSBAR) {
+        render_statusbar();
+    }
+    if (dirty & UPDATE_URLBAR) {
+        render_urlbar();
+    }
+    if (dirty & UPDATE_TITLE) {
+        render_title();
+    }
+
+    return false;
+}
+
+static void render_title(void)
+{
+    char *title;
+
 #ifdef FEATURE_TITLE_PROGRESS
     /* show load status of page or the downloads */
     if (vb.state.progress != 100) {
-        char *title = g_strdup_printf(
+        title = g_strdup_printf(
             "[%i%%] %s",
             vb.state.progress,
             vb.state.title ? vb.state.title : ""
         );
-        gtk_window_set_title(GTK_WINDOW(vb.gui.window), title);
+    } else
+#endif
+    if (vb.state.title) {
+        title = g_strdup(vb.state.title);
+    } else {
+        return;
+    }
+
+    /* setting the window title causes a roundtrip to the window manager so
+     * skip it if nothing changed */
+    if (gui_update.title && !strcmp(gui_update.title, title)) {
         g_free(title);
         return;
     }
-#endif
-    if (vb.state.title) {
-        gtk_window_set_title(GTK_WINDOW(vb.gui.window), vb.state.title);
+    gtk_window_set_title(GTK_WINDOW(vb.gui.window), title);
+    g_free(gui_update.title);
+    gui_update.title = title;
+}
+
+/**
+ * Sets the text on label if it differs from the last set text. The text
+ * must be allocated and is owned by this function afterwards.
+ */
+static void set_label_text(GtkWidget *label, char **last, char *text)
+{
+    if (*last && !strcmp(*last, text)) {
+        g_free(text);
+        return;
     }
+    gtk_label_set_text(GTK_LABEL(label), text);
+    g_free(*last);
+    *last = text;
 }
 
 static gboolean mimetype_decision_cb(WebKitWebView *webview,
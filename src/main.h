@@ -185,6 +185,7 @@ typedef enum {
 
 typedef enum {
     FILES_CONFIG,
+    FILES_CONFIG_CACHE,
 #ifdef FEATURE_COOKIE
     FILES_COOKIE,
 #endif
@@ -196,6 +197,10 @@ typedef enum {
     FILES_BOOKMARK,
 #ifdef FEATURE_QUEUE
     FILES_QUEUE,
+#endif
+#ifdef FEATURE_FULLTEXT
+    FILES_FULLTEXT,
+    FILES_FULLTEXT_LOG,
 #endif
     FILES_USER_STYLE,
     FILES_LAST
@@ -233,7 +238,7 @@ typedef struct {
 #define FLAG_NOMAP       0x0001  /* disables mapping for key strokes */
 #define FLAG_HINTING     0x0002  /* marks active hinting submode */
 #define FLAG_COMPLETION  0x0004  /* marks active completion submode */
-#define FLAG_PASSTHROUGH 0x0008  /* don't handle any other keybind than <esc> */
+#define FLAG_PASSTHROUGH 0x0008  /* pass unmapped keys directly to the webview */
     unsigned int         flags;
 } Mode;
 
@@ -274,11 +279,15 @@ typedef struct {
     char            *title;                 /* holds the window title */
 #define PROMPT_SIZE 3
     char            prompt[PROMPT_SIZE];    /* current prompt ':', ';o', '/' */
+    gboolean        replay;                 /* keys are replayed from a macro register */
+    guint           search_index;           /* number of the selected search match */
+    guint           search_count;           /* number of the search matches or 0 */
 } State;
 
 typedef struct {
     time_t     cookie_timeout;
     int        scrollstep;
+    gboolean   smooth_scroll;
     char       *home_page;
     char       *download_dir;
     guint      history_max;
@@ -331,13 +340,14 @@ void vb_set_input_text(const char *text);
 char *vb_get_input_text(void);
 void vb_input_activate(void);
 gboolean vb_eval_script(WebKitWebFrame *frame, char *script, char *file, char **value);
+char *vb_jsref_to_string(JSContextRef context, JSValueRef ref);
 gboolean vb_load_uri(const Arg *arg);
 gboolean vb_set_clipboard(const Arg *arg);
 void vb_set_widget_font(GtkWidget *widget, const VbColor *fg, const VbColor *bg, PangoFontDescription *font);
 void vb_update_statusbar(void);
 void vb_update_status_style(void);
 void vb_update_input_style(void);
-void vb_update_urlbar(const char *uri);
+void vb_update_urlbar(void);
 gboolean vb_download(WebKitWebView *view, WebKitDownload *download, const char *path);
 void vb_quit(void);
 
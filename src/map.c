@@ -23,6 +23,7 @@
 #include "normal.h"
 #include "ascii.h"
 #include "mode.h"
+#include "keystats.h"
 
 extern VbCore vb;
 
@@ -35,22 +36,51 @@ typedef struct {
     gboolean remap;     /* if false do not remap the {rhs} of this map */
 } Map;
 
+/* node of the mapping trie, each node represents one key byte of the lhs of
+ * the maps */
+typedef struct MapNode {
+    guchar         key;
+    Map            *map;    /* map whose lhs ends at this node or NULL */
+    struct MapNode *child;  /* first node for the following key */
+    struct MapNode *next;   /* next node with the same parent */
+} MapNode;
+
 static struct {
-    GSList *list;
-    char   queue[MAP_QUEUE_SIZE];   /* queue holding typed keys */
-    int    qlen;                    /* pointer to last char in queue */
+    GHashTable *tries;              /* root nodes of the map tries by mode */
+    char   queue[MAP_QUEUE_SIZE];   /* ring buffer holding typed keys */
+    int    head;                    /* position of the first key in queue */
+    int    qlen;                    /* number of keys in queue */
     int    resolved;                /* number of resolved keys (no mapping required) */
-    guint  timout_id;               /* source id of the timeout function */
+    GSource *timeout;               /* reusable source to flush ambiguous keys */
+    char    record_reg;             /* register to record into or 0 */
+    GString *record;                /* keys typed since recording was started */
+    GString *registers[128];        /* recorded macros by register name */
+    char    last_reg;               /* register of the last replayed macro */
+    int     replay_depth;           /* nesting level of replayed macros */
 } map;
 
+/* get the key at given position counted from the start of the queue */
+#define QUEUE_KEY(i) (map.queue[(map.head + (i)) % MAP_QUEUE_SIZE])
+
+static void queue_pop(int n);
+static void queue_splice(int len, const char *keys, int keylen);
 static gboolean map_delete_by_lhs(const char *lhs, int len, char mode);
+static MapNode *trie_get_root(char mode, gboolean create);
+static MapNode *trie_get_child(MapNode *node, guchar key, gboolean create);
+static void trie_lookup(MapNode *root, Map **match, gboolean *ambiguous);
+static void free_trie(MapNode *node);
 static int keyval_to_string(guint keyval, guint state, guchar *string);
 static int utf_char2bytes(guint c, guchar *buf);
 static char *convert_keys(char *in, int inlen, int *len);
 static char *convert_keylabel(char *in, int inlen, int *len);
-static gboolean do_timeout(gpointer data);
+static void timeout_arm(void);
+static void timeout_disarm(void);
+static gboolean do_timeout(GSource *source, GSourceFunc callback, gpointer data);
 static void free_map(Map *map);
 
+/* the timeout source has no fd to poll, it's dispatched by its ready time */
+static GSourceFuncs timeout_funcs = {NULL, NULL, do_timeout, NULL};
+
 static struct {
     guint state;
     guint keyval;
@@ -107,8 +137,25 @@ static struct {
 
 void map_cleanup(void)
 {
-    if (map.list) {
-        g_slist_free_full(map.list, (GDestroyNotify)free_map);
+    if (map.tries) {
+        g_hash_table_destroy(map.tries);
+        map.tries = NULL;
+    }
+    if (map.timeout) {
+        g_source_destroy(map.timeout);
+        g_source_unref(map.timeout);
+        map.timeout = NULL;
+    }
+    if (map.record) {
+        g_string_free(map.record, true);
+        map.record     = NULL;
+        map.record_reg = 0;
+    }
+    for (int i = 0; i < LENGTH(map.registers); i++) {
+        if (map.registers[i]) {
+            g_string_free(map.registers[i], true);
+            map.registers[i] = NULL;
+        }
     }
 }
 
@@ -122,6 +169,24 @@ gboolean map_keypress(GtkWidget *widget, GdkEventKey* event, gpointer data)
     guint keyval = event->keyval;
     guchar string[32];
     int len;
+    MapNode *root;
+    gboolean record = map.record_reg != 0;
+    KEYSTATS_START(start, vb.mode->id);
+
+    /* in modes that pass most keys to the webview there is nothing to do if
+     * no map exists for the mode and no keys are pending - only the escape
+     * key and control keys are used by the modes itself */
+    if ((vb.mode->flags & FLAG_PASSTHROUGH)
+        && !(vb.mode->flags & FLAG_NOMAP)
+        && !map.qlen
+        && !record
+        && keyval != GDK_Escape
+        && !(state & GDK_CONTROL_MASK)
+        && (!(root = trie_get_root(vb.mode->id, false)) || !root->child)
+    ) {
+        KEYSTATS_STOP(start, KEYSTATS_KEY);
+        return false;
+    }
 
     len = keyval_to_string(keyval, state, string);
 
@@ -149,12 +214,22 @@ gboolean map_keypress(GtkWidget *widget, GdkEventKey* event, gpointer data)
     if (len == 0) {
         /* mark all unknown key events as unhandled to not break some gtk features
          * like <S-Einf> to copy clipboard content into inputbox */
+        KEYSTATS_STOP(start, KEYSTATS_KEY);
         return false;
     }
 
     vb.state.processed_key = true;
+    KEYSTATS_START(mapstart, start_mode);
     map_handle_keys(string, len, true);
+    KEYSTATS_STOP(mapstart, KEYSTATS_MAP);
+
+    /* record the typed keys, but not those that started or stopped the
+     * recording */
+    if (record && map.record_reg) {
+        g_string_append_len(map.record, (char*)string, len);
+    }
 
+    KEYSTATS_STOP(start, KEYSTATS_KEY);
     return vb.state.processed_key;
 }
 
@@ -165,28 +240,18 @@ gboolean map_keypress(GtkWidget *widget, GdkEventKey* event, gpointer data)
  */
 MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map)
 {
-    int ambiguous;
+    gboolean ambiguous;
     Map *match = NULL;
     gboolean timeout = (keylen == 0); /* keylen 0 signalized timeout */
 
-    /* don't set the timeout function if a timeout is handled */
-    if (!timeout) {
-        /* if a previous timeout function was set remove this to start the
-         * timeout new */
-        if (map.timout_id) {
-            g_source_remove(map.timout_id);
+    while (true) {
+        /* copy the keys onto the end of queue - keys that do not fit are
+         * added after the queued keys are processed */
+        while (map.qlen < MAP_QUEUE_SIZE && keylen > 0) {
+            QUEUE_KEY(map.qlen++) = *keys++;
+            keylen--;
         }
-        map.timout_id = g_timeout_add(vb.config.timeoutlen, (GSourceFunc)do_timeout, NULL);
-    }
-
-    /* copy the keys onto the end of queue */
-    while (map.qlen < LENGTH(map.queue) && keylen > 0) {
-        map.queue[map.qlen++] = *keys++;
-        keylen--;
-    }
 
-    /* try to resolve keys against the map */
-    while (true) {
         /* send any resolved key to the parser */
         while (map.resolved > 0) {
             int qk;
@@ -195,23 +260,14 @@ MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map)
              * isn't part of a mapped command we let gtk handle the key - this
              * is required allo to move cursor in inputbox with <Left> and
              * <Right> keys */
-            if ((map.queue[0] & 0xff) == CSI && map.qlen >= 3) {
+            if ((QUEUE_KEY(0) & 0xff) == CSI && map.qlen >= 3) {
                 /* get next 2 chars to build the termcap key */
-                qk = TERMCAP2KEY(map.queue[1], map.queue[2]);
-
-                map.resolved -= 3;
-                map.qlen     -= 3;
-                /* move all other queue entries three steps to the left */
-                g_memmove(map.queue, map.queue + 3, map.qlen);
+                qk = TERMCAP2KEY(QUEUE_KEY(1), QUEUE_KEY(2));
+                queue_pop(3);
             } else {
                 /* get first char of queue */
-                qk = map.queue[0];
-
-                map.resolved--;
-                map.qlen--;
-
-                /* move all other queue entries one step to the left */
-                g_memmove(map.queue, map.queue + 1, map.qlen);
+                qk = QUEUE_KEY(0);
+                queue_pop(1);
             }
 
             /* remove the nomap flag */
@@ -226,48 +282,40 @@ MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map)
         /* if all keys where processed return MAP_DONE */
         if (map.qlen == 0) {
             map.resolved = 0;
+            if (keylen > 0) {
+                continue;
+            }
+            /* nothing left that could wait for a timeout */
+            timeout_disarm();
             return match ? MAP_DONE : MAP_NOMATCH;
         }
 
         /* try to find matching maps */
         match     = NULL;
-        ambiguous = 0;
+        ambiguous = false;
         if (use_map && !(vb.mode->flags & FLAG_NOMAP)) {
-            for (GSList *l = map.list; l != NULL; l = l->next) {
-                Map *m = (Map*)l->data;
-                /* ignore maps for other modes */
-                if (m->mode != vb.mode->id) {
+            trie_lookup(trie_get_root(vb.mode->id, false), &match, &ambiguous);
+
+            /* if there are ambiguous matches return MAP_KEY and flush queue
+             * after a timeout if the user do not type more keys */
+            if (ambiguous && !timeout) {
+                /* following keys may resolve the ambiguity */
+                if (keylen > 0 && map.qlen < MAP_QUEUE_SIZE) {
                     continue;
                 }
 
-                /* find ambiguous matches */
-                if (!timeout && m->inlen > map.qlen && !strncmp(m->in, map.queue, map.qlen)) {
-                    if (ambiguous == 0) {
-                        /* show command chars for the ambiguous commands */
-                        int i = map.qlen > SHOWCMD_LEN ? map.qlen - SHOWCMD_LEN : 0;
-                        /* only appending the last queue char does not work
-                         * with the multi char termcap entries, so we flush
-                         * the show command and put the chars into it again */
-                        normal_showcmd(0);
-                        while (i < map.qlen) {
-                            normal_showcmd(map.queue[i++]);
-                        }
-                    }
-                    ambiguous++;
-                }
-                /* complete match or better/longer match than previous found */
-                if (m->inlen <= map.qlen
-                    && !strncmp(m->in, map.queue, m->inlen)
-                    && (!match || match->inlen < m->inlen)
-                ) {
-                    /* backup this found possible match */
-                    match = m;
+                /* show command chars for the ambiguous commands */
+                int i = map.qlen > SHOWCMD_LEN ? map.qlen - SHOWCMD_LEN : 0;
+                /* only appending the last queue char does not work with the
+                 * multi char termcap entries, so we flush the show command
+                 * and put the chars into it again */
+                normal_showcmd(0);
+                while (i < map.qlen) {
+                    normal_showcmd(QUEUE_KEY(i++));
                 }
-            }
 
-            /* if there are ambiguous matches return MAP_KEY and flush queue
-             * after a timeout if the user do not type more keys */
-            if (ambiguous) {
+                /* (re)start the timeout to flush the queue */
+                timeout_arm();
                 return MAP_AMBIGUOUS;
             }
         }
@@ -275,30 +323,15 @@ MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map)
         /* replace the matched chars from queue by the cooked string that
          * is the result of the mapping */
         if (match) {
-            int i, j;
             /* flush ths show command to make room for possible mapped command
              * chars to show for example if :nmap foo 12g is use we want to
              * display the incomplete 12g command */
             normal_showcmd(0);
-            if (match->inlen < match->mappedlen) {
-                /* make some space within the queue */
-                for (i = map.qlen + match->mappedlen - match->inlen, j = map.qlen; j > match->inlen; ) {
-                    map.queue[--i] = map.queue[--j];
-                }
-            } else if (match->inlen > match->mappedlen) {
-                /* delete some keys */
-                for (i = match->mappedlen, j = match->inlen; i < map.qlen; ) {
-                    map.queue[i++] = map.queue[j++];
-                }
-            }
-
-            /* copy the mapped string into the queue */
-            strncpy(map.queue, match->mapped, match->mappedlen);
-            map.qlen += match->mappedlen - match->inlen;
+            queue_splice(match->inlen, match->mapped, match->mappedlen);
 
             /* without remap the mapped chars are resolved now */
             if (!match->remap) {
-                map.resolved = match->mappedlen;
+                map.resolved = MIN(match->mappedlen, map.qlen);
             } else if (match->inlen <= match->mappedlen
                 && !strncmp(match->in, match->mapped, match->inlen)
             ) {
@@ -314,6 +347,150 @@ MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map)
     return MAP_DONE;
 }
 
+/**
+ * Removes given number of keys from the start of the queue.
+ */
+static void queue_pop(int n)
+{
+    map.head     = (map.head + n) % MAP_QUEUE_SIZE;
+    map.qlen    -= n;
+    map.resolved = MAX(map.resolved - n, 0);
+}
+
+/**
+ * Replaces the first len keys of the queue by given keys. The new keys are
+ * written in front of the remaining keys, so no other key has to be moved.
+ * If the queue becomes too large the keys at the end are dropped.
+ */
+static void queue_splice(int len, const char *keys, int keylen)
+{
+    int rest = map.qlen - len;
+
+    if (keylen > MAP_QUEUE_SIZE) {
+        keylen = MAP_QUEUE_SIZE;
+    }
+    if (rest > MAP_QUEUE_SIZE - keylen) {
+        rest = MAP_QUEUE_SIZE - keylen;
+    }
+
+    /* move the head in front of the remaining keys and write the new ones */
+    map.head = (map.head + len - keylen + MAP_QUEUE_SIZE) % MAP_QUEUE_SIZE;
+    map.qlen = keylen + rest;
+    for (int i = 0; i < keylen; i++) {
+        QUEUE_KEY(i) = keys[i];
+    }
+}
+
+/**
+ * Start to record the typed keys into given register.
+ */
+gboolean map_record_start(char reg)
+{
+    if (!g_ascii_isalnum(reg)) {
+        return false;
+    }
+    map.record_reg = reg;
+    if (map.record) {
+        g_string_truncate(map.record, 0);
+    } else {
+        map.record = g_string_new(NULL);
+    }
+
+    return true;
+}
+
+/**
+ * Stops a running recording and save the recorded keys into the register.
+ * Returns true if there was a recording to stop.
+ */
+gboolean map_record_stop(void)
+{
+    GString **reg;
+
+    if (!map.record_reg) {
+        return false;
+    }
+
+    reg = &map.registers[(guchar)map.record_reg];
+    if (*reg) {
+        g_string_free(*reg, true);
+    }
+    /* move the recorded string into the register */
+    *reg           = map.record;
+    map.record     = NULL;
+    map.record_reg = 0;
+
+    return true;
+}
+
+gboolean map_is_recording(void)
+{
+    return map.record_reg != 0;
+}
+
+/**
+ * Runs the keys recorded in register count times. The keys are processed
+ * in one go without waiting for the key timeout in between. The register @
+ * refers to the last replayed register.
+ */
+gboolean map_replay(char reg, int count)
+{
+    GString *keys;
+    char *pending;
+    int qlen, resolved;
+
+    if (reg == '@') {
+        reg = map.last_reg;
+    }
+    if (!g_ascii_isalnum(reg) || !(keys = map.registers[(guchar)reg]) || !keys->len) {
+        return false;
+    }
+    if (map.replay_depth >= MAP_REPLAY_DEPTH) {
+        vb_echo(VB_MSG_ERROR, true, "Macros nested too deep");
+        return false;
+    }
+    map.last_reg = reg;
+
+    /* take the keys that are still queued behind the key that triggered the
+     * replay out of the queue, to process them after the replayed keys */
+    qlen     = map.qlen;
+    resolved = map.resolved;
+    pending  = g_new(char, qlen + 1);
+    for (int i = 0; i < qlen; i++) {
+        pending[i] = QUEUE_KEY(i);
+    }
+    map.qlen = map.resolved = 0;
+
+    map.replay_depth++;
+    vb.state.replay = true;
+    while (count-- > 0) {
+        map_handle_keys((guchar*)keys->str, keys->len, true);
+    }
+    /* flush keys that are ambiguous at the end of the macro immediately */
+    if (map.qlen) {
+        map_handle_keys((guchar*)"", 0, true);
+    }
+    map.replay_depth--;
+    vb.state.replay = map.replay_depth > 0;
+    if (!vb.state.replay) {
+        normal_showcmd(0);
+    }
+
+    /* put the pending keys back into the queue - the queue was completely
+     * processed by now */
+    for (int i = 0; i < qlen; i++) {
+        QUEUE_KEY(i) = pending[i];
+    }
+    map.qlen     = qlen;
+    map.resolved = resolved;
+    g_free(pending);
+
+    /* the key that triggered the replay was handled */
+    vb.state.processed_key = true;
+
+    return true;
+}
+
 /**
  * Like map_handle_keys but use a null terminates string with untranslated
  * keys like <C-T> that are converted here before calling map_handle_keys.
@@ -329,11 +506,15 @@ void map_handle_string(char *str, gboolean use_map)
 void map_insert(char *in, char *mapped, char mode, gboolean remap)
 {
     int inlen, mappedlen;
+    MapNode *node;
     char *lhs = convert_keys(in, strlen(in), &inlen);
     char *rhs = convert_keys(mapped, strlen(mapped), &mappedlen);
 
-    /* if lhs was already mapped, remove this first */
-    map_delete_by_lhs(lhs, inlen, mode);
+    if (!inlen) {
+        g_free(lhs);
+        g_free(rhs);
+        return;
+    }
 
     Map *new = g_new(Map, 1);
     new->in        = lhs;
@@ -343,30 +524,143 @@ void map_insert(char *in, char *mapped, char mode, gboolean remap)
     new->mode      = mode;
     new->remap     = remap;
 
-    map.list = g_slist_prepend(map.list, new);
+    /* walk down the trie of the mode along the lhs keys */
+    node = trie_get_root(mode, true);
+    for (int i = 0; i < inlen; i++) {
+        node = trie_get_child(node, (guchar)lhs[i], true);
+    }
+
+    /* if lhs was already mapped, replace the previous map */
+    if (node->map) {
+        free_map(node->map);
+    }
+    node->map = new;
 }
 
 gboolean map_delete(char *in, char mode)
 {
     int len;
+    gboolean result;
     char *lhs = convert_keys(in, strlen(in), &len);
 
-    return map_delete_by_lhs(lhs, len, mode);
+    result = map_delete_by_lhs(lhs, len, mode);
+    g_free(lhs);
+
+    return result;
 }
 
 static gboolean map_delete_by_lhs(const char *lhs, int len, char mode)
 {
-    for (GSList *l = map.list; l != NULL; l = l->next) {
-        Map *m = (Map*)l->data;
-
-        /* remove only if the map's lhs matches the given key sequence */
-        if (m->mode == mode && m->inlen == len && !strcmp(m->in, lhs)) {
-            /* remove the found list item */
-            map.list = g_slist_delete_link(map.list, l);
-            return true;
+    MapNode *node, *parent, **link, **path;
+    int i;
+
+    if (!len || !(node = trie_get_root(mode, false))) {
+        return false;
+    }
+
+    /* remember the nodes along the lhs to remove unused nodes afterwards */
+    path    = g_new(MapNode*, len + 1);
+    path[0] = node;
+    for (i = 0; i < len && node; i++) {
+        node        = trie_get_child(node, (guchar)lhs[i], false);
+        path[i + 1] = node;
+    }
+    if (!node || !node->map) {
+        g_free(path);
+        return false;
+    }
+
+    free_map(node->map);
+    node->map = NULL;
+
+    /* remove the nodes that do not lead to any map anymore */
+    for (i = len; i > 0 && !path[i]->map && !path[i]->child; i--) {
+        parent = path[i - 1];
+        for (link = &parent->child; *link != path[i]; link = &(*link)->next);
+        *link = path[i]->next;
+        g_free(path[i]);
+    }
+    g_free(path);
+
+    return true;
+}
+
+/**
+ * Retrieves the root node of the map trie for given mode. If create is set
+ * the trie is created if it does not exist.
+ */
+static MapNode *trie_get_root(char mode, gboolean create)
+{
+    MapNode *root;
+
+    if (!map.tries) {
+        if (!create) {
+            return NULL;
         }
+        map.tries = g_hash_table_new_full(
+            g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)free_trie
+        );
     }
-    return false;
+
+    root = g_hash_table_lookup(map.tries, GINT_TO_POINTER(mode));
+    if (!root && create) {
+        root = g_new0(MapNode, 1);
+        g_hash_table_insert(map.tries, GINT_TO_POINTER(mode), root);
+    }
+
+    return root;
+}
+
+/**
+ * Retrieves the child node of given trie node for the key. If create is set
+ * a missing node is added.
+ */
+static MapNode *trie_get_child(MapNode *node, guchar key, gboolean create)
+{
+    MapNode *child;
+
+    for (child = node->child; child; child = child->next) {
+        if (child->key == key) {
+            return child;
+        }
+    }
+    if (create) {
+        child        = g_new0(MapNode, 1);
+        child->key   = key;
+        child->next  = node->child;
+        node->child  = child;
+    }
+
+    return child;
+}
+
+/**
+ * Walks the keys of the queue down the trie. The longest map whose lhs is a
+ * prefix of the queue is written to match. If the queue is a prefix of
+ * longer maps ambiguous is set.
+ */
+static void trie_lookup(MapNode *root, Map **match, gboolean *ambiguous)
+{
+    MapNode *node = root;
+
+    *match     = NULL;
+    *ambiguous = false;
+    if (!node) {
+        return;
+    }
+
+    for (int i = 0; i < map.qlen; i++) {
+        node = trie_get_child(node, (guchar)QUEUE_KEY(i), false);
+        if (!node) {
+            return;
+        }
+        if (node->map) {
+            *match = node->map;
+        }
+    }
+
+    /* all queued keys are consumed and there are still longer maps */
+    *ambiguous = (node->child != NULL);
 }
 
 /**
@@ -568,15 +862,60 @@ static char *convert_keylabel(char *in, int inlen, int *len)
 }
 
 /**
- * Timeout function to signalize a key timeout to the map.
+ * Start the key timeout or restart it if it's already running. The source is
+ * created once and afterwards only its ready time is moved, so that typing
+ * does not create and destroy a source for each key.
  */
-static gboolean do_timeout(gpointer data)
+static void timeout_arm(void)
 {
+    if (!map.timeout) {
+        map.timeout = g_source_new(&timeout_funcs, sizeof(GSource));
+        g_source_attach(map.timeout, NULL);
+    }
+    g_source_set_ready_time(
+        map.timeout, g_get_monotonic_time() + vb.config.timeoutlen * 1000
+    );
+}
+
+/**
+ * Stop the key timeout without destroying the source.
+ */
+static void timeout_disarm(void)
+{
+    if (map.timeout) {
+        g_source_set_ready_time(map.timeout, -1);
+    }
+}
+
+/**
+ * Dispatch function of the timeout source to signalize a key timeout to the
+ * map.
+ */
+static gboolean do_timeout(GSource *source, GSourceFunc callback, gpointer data)
+{
+    /* fire only once until the timeout is armed again */
+    g_source_set_ready_time(source, -1);
+
     /* signalize the timeout to the key handler */
     map_handle_keys((guchar*)"", 0, true);
 
-    /* call only once */
-    return false;
+    /* keep the source to be reused */
+    return true;
+}
+
+static void free_trie(MapNode *node)
+{
+    MapNode *next;
+
+    while (node) {
+        next = node->next;
+        free_trie(node->child);
+        if (node->map) {
+            free_map(node->map);
+        }
+        g_free(node);
+        node = next;
+    }
 }
 
 static void free_map(Map *map)
@@ -26,6 +26,9 @@
  * string */
 #define MAP_QUEUE_SIZE 500
 
+/* maximum nesting level of macros that replay other macros */
+#define MAP_REPLAY_DEPTH 20
+
 typedef enum {
     MAP_DONE,
     MAP_AMBIGUOUS,
@@ -38,5 +41,9 @@ MapState map_handle_keys(const guchar *keys, int keylen, gboolean use_map);
 void map_handle_string(char *str, gboolean use_map);
 void map_insert(char *in, char *mapped, char mode, gboolean remap);
 gboolean map_delete(char *in, char mode);
+gboolean map_record_start(char reg);
+gboolean map_record_stop(void);
+gboolean map_is_recording(void);
+gboolean map_replay(char reg, int count);
 
 #endif /* end of include guard: _MAP_H */
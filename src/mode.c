@@ -21,6 +21,7 @@
 #include "main.h"
 #include "mode.h"
 #include "normal.h"
+#include "keystats.h"
 
 static GHashTable *modes = NULL;
 extern VbCore vb;
@@ -140,7 +141,9 @@ VbResult mode_handle_key(int key)
         int flags = vb.mode->flags;
         int id    = vb.mode->id;
 #endif
+        KEYSTATS_START(start, vb.mode->id);
         res = vb.mode->keypress(key);
+        KEYSTATS_STOP(start, KEYSTATS_MODE);
         if (vb.mode) {
             PRINT_DEBUG(
                 "%c: key[0x%x %c] flags[%d] >> %c: flags[%d]",
@@ -29,6 +29,8 @@
 #include "dom.h"
 #include "history.h"
 #include "util.h"
+#include "ex.h"
+#include "map.h"
 
 /* convert the lower 4 bits of byte n to its hex character */
 #define NR2HEX(n)   (n & 0xf) <= 9 ? (n & 0xf) + '0' : (c & 0xf) - 10 + 'a'
@@ -36,6 +38,7 @@
 typedef enum {
     PHASE_START,
     PHASE_KEY2,
+    PHASE_KEY3,
     PHASE_COMPLETE,
 } Phase;
 
@@ -43,12 +46,22 @@ struct NormalCmdInfo_s {
     int count;   /* count used for the command */
     char cmd;    /* command key */
     char ncmd;   /* second command key (optional) */
+    char xcmd;   /* third command key (optional) */
     Phase phase; /* current parsing phase */
-} info = {0, '\0', '\0', PHASE_START};
+} info = {0, '\0', '\0', '\0', PHASE_START};
 
 typedef VbResult (*NormalCommand)(const NormalCmdInfo *info);
 
 static char *transchar(int c);
+static void scroll_by(GtkAdjustment *adjust, gdouble delta);
+static void scroll_to(GtkAdjustment *adjust, gdouble value);
+static gboolean scroll_step(GtkAdjustment *adjust, gdouble *pending);
+static gboolean scroll_frame(void);
+#if GTK_CHECK_VERSION(3, 8, 0)
+static gboolean scroll_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data);
+#else
+static gboolean scroll_timeout(gpointer data);
+#endif
 
 static VbResult normal_clear_input(const NormalCmdInfo *info);
 static VbResult normal_descent(const NormalCmdInfo *info);
@@ -64,6 +77,9 @@ static VbResult normal_pass(const NormalCmdInfo *info);
 static VbResult normal_prevnext(const NormalCmdInfo *info);
 static VbResult normal_queue(const NormalCmdInfo *info);
 static VbResult normal_quit(const NormalCmdInfo *info);
+static VbResult normal_rapid_hint(const NormalCmdInfo *info);
+static VbResult normal_record_macro(const NormalCmdInfo *info);
+static VbResult normal_replay_macro(const NormalCmdInfo *info);
 static VbResult normal_scroll(const NormalCmdInfo *info);
 static VbResult normal_search(const NormalCmdInfo *info);
 static VbResult normal_search_selection(const NormalCmdInfo *info);
@@ -139,7 +155,7 @@ static struct {
 /* =   0x3d */ {NULL},
 /* >   0x3e */ {NULL},
 /* ?   0x3f */ {normal_ex},
-/* @   0x40 */ {NULL},
+/* @   0x40 */ {normal_replay_macro},
 /* A   0x41 */ {NULL},
 /* B   0x42 */ {NULL},
 /* C   0x43 */ {NULL},
@@ -188,7 +204,7 @@ static struct {
 /* n   0x6e */ {normal_search},
 /* o   0x6f */ {normal_input_open},
 /* p   0x70 */ {normal_open_clipboard},
-/* q   0x71 */ {NULL},
+/* q   0x71 */ {normal_record_macro},
 /* r   0x72 */ {normal_navigate},
 /* s   0x73 */ {NULL},
 /* t   0x74 */ {normal_input_open},
@@ -209,6 +225,13 @@ extern VbCore vb;
 
 static char showcmd_buf[SHOWCMD_LEN + 1];   /* buffer to show ambiguous key sequence */
 
+/* scroll distance not yet applied to the adjustments */
+static struct {
+    gdouble dx;
+    gdouble dy;
+    guint   tick;   /* id of the tick callback or timeout applying the distance */
+} scroll;
+
 /**
  * Function called when vimb enters the normal mode.
  */
@@ -242,10 +265,19 @@ VbResult normal_keypress(int key)
         info.phase = PHASE_COMPLETE;
     } else if (info.phase == PHASE_KEY2) {
         info.ncmd = key;
+        if (info.cmd == 'g' && key == ';') {
+            /* g; needs the hint mode as third key */
+            info.phase = PHASE_KEY3;
+            vb.mode->flags |= FLAG_NOMAP;
+        } else {
+            info.phase = PHASE_COMPLETE;
+        }
+    } else if (info.phase == PHASE_KEY3) {
+        info.xcmd = key;
         info.phase = PHASE_COMPLETE;
     } else if (info.phase == PHASE_START && isdigit(key)) {
         info.count = info.count * 10 + key - '0';
-    } else if (strchr(";zg[]", (char)key)) {
+    } else if (strchr(";zg[]@", (char)key) || (key == 'q' && !map_is_recording())) {
         /* handle commands that needs additional char */
         info.phase = PHASE_KEY2;
         info.cmd   = key;
@@ -272,7 +304,7 @@ VbResult normal_keypress(int key)
 
     if (res == RESULT_COMPLETE) {
         /* unset the info */
-        info.cmd = info.ncmd = info.count = 0;
+        info.cmd = info.ncmd = info.xcmd = info.count = 0;
         info.phase = PHASE_START;
     } else if (res == RESULT_MORE) {
         normal_showcmd(key);
@@ -300,8 +332,10 @@ void normal_showcmd(int c)
     } else {
         showcmd_buf[0] = '\0';
     }
-    /* show the typed keys */
-    gtk_label_set_text(GTK_LABEL(vb.gui.statusbar.cmd), showcmd_buf);
+    /* show the typed keys - but not for each key of a replayed macro */
+    if (!vb.state.replay) {
+        gtk_label_set_text(GTK_LABEL(vb.gui.statusbar.cmd), showcmd_buf);
+    }
 }
 
 /**
@@ -328,11 +362,112 @@ static char *transchar(int c)
     return trans;
 }
 
+/**
+ * Adds delta to the pending scroll distance of the adjustment. The pending
+ * distances are applied on the next frame, so that fast repeated scroll
+ * commands lead only to one redraw per frame.
+ */
+static void scroll_by(GtkAdjustment *adjust, gdouble delta)
+{
+    gdouble *pending, value, max;
+
+    pending = adjust == vb.gui.adjust_h ? &scroll.dx : &scroll.dy;
+    value   = gtk_adjustment_get_value(adjust);
+    max     = gtk_adjustment_get_upper(adjust) - gtk_adjustment_get_page_size(adjust);
+
+    /* don't collect distance beyond the page bounds, else scrolling back
+     * would be delayed until the collected distance is used up */
+    *pending = CLAMP(value + *pending + delta, gtk_adjustment_get_lower(adjust), max) - value;
+
+    if (*pending && !scroll.tick) {
+#if GTK_CHECK_VERSION(3, 8, 0)
+        scroll.tick = gtk_widget_add_tick_callback(
+            GTK_WIDGET(vb.gui.webview), scroll_tick, NULL, NULL
+        );
+#else
+        scroll.tick = g_timeout_add(SCROLL_FRAME_TIME, scroll_timeout, NULL);
+#endif
+    }
+}
+
+/**
+ * Scrolls to the absolute position and drops the pending scroll distance of
+ * the adjustment.
+ */
+static void scroll_to(GtkAdjustment *adjust, gdouble value)
+{
+    gdouble max;
+
+    if (adjust == vb.gui.adjust_h) {
+        scroll.dx = 0;
+    } else {
+        scroll.dy = 0;
+    }
+    max = gtk_adjustment_get_upper(adjust) - gtk_adjustment_get_page_size(adjust);
+    gtk_adjustment_set_value(adjust, value > max ? max : value);
+}
+
+/**
+ * Applies the pending scroll distance of the adjustment. With smooth-scroll
+ * only a part of the distance is used per frame.
+ * Returns true if there is still distance left for the next frame.
+ */
+static gboolean scroll_step(GtkAdjustment *adjust, gdouble *pending)
+{
+    gdouble step;
+
+    if (!*pending) {
+        return false;
+    }
+    step = *pending;
+    if (vb.config.smooth_scroll && ABS(step) > 1) {
+        step *= SMOOTH_SCROLL_STEP;
+        if (ABS(step) < 1) {
+            step = step < 0 ? -1 : 1;
+        }
+    }
+    *pending -= step;
+    gtk_adjustment_set_value(adjust, gtk_adjustment_get_value(adjust) + step);
+
+    return *pending != 0;
+}
+
+/**
+ * Called once per frame as long as there is scroll distance pending.
+ */
+static gboolean scroll_frame(void)
+{
+    gboolean more;
+
+    more  = scroll_step(vb.gui.adjust_h, &scroll.dx);
+    more |= scroll_step(vb.gui.adjust_v, &scroll.dy);
+    if (!more) {
+        scroll.tick = 0;
+    }
+
+    return more;
+}
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+static gboolean scroll_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data)
+{
+    return scroll_frame();
+}
+#else
+static gboolean scroll_timeout(gpointer data)
+{
+    return scroll_frame();
+}
+#endif
+
 static VbResult normal_clear_input(const NormalCmdInfo *info)
 {
     vb_set_input_text("");
     gtk_widget_grab_focus(GTK_WIDGET(vb.gui.webview));
     command_search(&((Arg){0}));
+    if (ex_shellcmd_cancel()) {
+        vb_echo(VB_MSG_NORMAL, true, "Shell command killed");
+    }
 
     return RESULT_COMPLETE;
 }
@@ -438,6 +573,9 @@ static VbResult normal_g_cmd(const NormalCmdInfo *info)
         case 'i':
             return normal_focus_input(info);
 
+        case ';':
+            return normal_rapid_hint(info);
+
         case 'U':
         case 'u':
             return normal_descent(info);
@@ -571,79 +709,109 @@ static VbResult normal_quit(const NormalCmdInfo *info)
     return RESULT_COMPLETE;
 }
 
+/**
+ * Starts a hint mode that stays active after each selection and collects
+ * the hinted uris until they are used together on <CR>.
+ */
+static VbResult normal_rapid_hint(const NormalCmdInfo *info)
+{
+    char prompt[3] = {';', info->xcmd, 0};
+#ifdef FEATURE_QUEUE
+    const char *allowed = "pPsty";
+#else
+    const char *allowed = "sty";
+#endif
+
+    if (!info->xcmd || !strchr(allowed, info->xcmd)) {
+        return RESULT_ERROR;
+    }
+
+    hints_set_rapid(true);
+    mode_enter_promt('c', prompt, true);
+    return RESULT_COMPLETE;
+}
+
+static VbResult normal_record_macro(const NormalCmdInfo *info)
+{
+    /* q without register stops a running recording */
+    if (map_record_stop()) {
+        vb_echo(VB_MSG_NORMAL, false, "");
+        return RESULT_COMPLETE;
+    }
+    if (!map_record_start(info->ncmd)) {
+        return RESULT_ERROR;
+    }
+    vb_echo(VB_MSG_NORMAL, false, "recording @%c", info->ncmd);
+
+    return RESULT_COMPLETE;
+}
+
+static VbResult normal_replay_macro(const NormalCmdInfo *info)
+{
+    if (!map_replay(info->ncmd, info->count ? info->count : 1)) {
+        return RESULT_ERROR;
+    }
+    return RESULT_COMPLETE;
+}
+
 static VbResult normal_scroll(const NormalCmdInfo *info)
 {
     GtkAdjustment *adjust;
-    gdouble value, max, new;
+    gdouble max;
     int count = info->count ? info->count : 1;
 
-    /* TODO split this into more functions - reduce similar code */
     switch (info->cmd) {
         case 'h':
-            adjust = vb.gui.adjust_h;
-            value  = vb.config.scrollstep;
-            new    = gtk_adjustment_get_value(adjust) - value * count;
+            scroll_by(vb.gui.adjust_h, -vb.config.scrollstep * count);
             break;
         case 'j':
-            adjust = vb.gui.adjust_v;
-            value  = vb.config.scrollstep;
-            new    = gtk_adjustment_get_value(adjust) + value * count;
+            scroll_by(vb.gui.adjust_v, vb.config.scrollstep * count);
             break;
         case 'k':
-            adjust = vb.gui.adjust_v;
-            value  = vb.config.scrollstep;
-            new    = gtk_adjustment_get_value(adjust) - value * count;
+            scroll_by(vb.gui.adjust_v, -vb.config.scrollstep * count);
             break;
         case 'l':
-            adjust = vb.gui.adjust_h;
-            value  = vb.config.scrollstep;
-            new    = gtk_adjustment_get_value(adjust) + value * count;
+            scroll_by(vb.gui.adjust_h, vb.config.scrollstep * count);
             break;
         case CTRL('D'):
             adjust = vb.gui.adjust_v;
-            value  = gtk_adjustment_get_page_size(adjust) / 2;
-            new    = gtk_adjustment_get_value(adjust) + value * count;
+            scroll_by(adjust, gtk_adjustment_get_page_size(adjust) / 2 * count);
             break;
         case CTRL('U'):
             adjust = vb.gui.adjust_v;
-            value  = gtk_adjustment_get_page_size(adjust) / 2;
-            new    = gtk_adjustment_get_value(adjust) - value * count;
+            scroll_by(adjust, -gtk_adjustment_get_page_size(adjust) / 2 * count);
             break;
         case CTRL('F'):
             adjust = vb.gui.adjust_v;
-            value  = gtk_adjustment_get_page_size(adjust);
-            new    = gtk_adjustment_get_value(adjust) + value * count;
+            scroll_by(adjust, gtk_adjustment_get_page_size(adjust) * count);
             break;
         case CTRL('B'):
             adjust = vb.gui.adjust_v;
-            value  = gtk_adjustment_get_page_size(adjust);
-            new    = gtk_adjustment_get_value(adjust) - value * count;
+            scroll_by(adjust, -gtk_adjustment_get_page_size(adjust) * count);
             break;
         case 'G':
             adjust = vb.gui.adjust_v;
             max    = gtk_adjustment_get_upper(adjust) - gtk_adjustment_get_page_size(adjust);
-            new    = info->count ? (max * info->count / 100) : gtk_adjustment_get_upper(adjust);
+            scroll_to(adjust, info->count ? (max * info->count / 100) : gtk_adjustment_get_upper(adjust));
             break;
         case '0':
             adjust = vb.gui.adjust_h;
-            new    = gtk_adjustment_get_lower(adjust);
+            scroll_to(adjust, gtk_adjustment_get_lower(adjust));
             break;
         case '$':
             adjust = vb.gui.adjust_h;
-            new    = gtk_adjustment_get_upper(adjust);
+            scroll_to(adjust, gtk_adjustment_get_upper(adjust));
             break;
 
         default:
             if (info->ncmd == 'g') {
                 adjust = vb.gui.adjust_v;
                 max    = gtk_adjustment_get_upper(adjust) - gtk_adjustment_get_page_size(adjust);
-                new    = info->count ? (max * info->count / 100) : gtk_adjustment_get_lower(adjust);
+                scroll_to(adjust, info->count ? (max * info->count / 100) : gtk_adjustment_get_lower(adjust));
                 break;
             }
             return RESULT_ERROR;
     }
-    max = gtk_adjustment_get_upper(adjust) - gtk_adjustment_get_page_size(adjust);
-    gtk_adjustment_set_value(adjust, new > max ? max : new);
 
     return RESULT_COMPLETE;
 }
@@ -0,0 +1,309 @@
+var VbSearch = (function(){
+    'use strict';
+
+    var matches   = [],                 /* ranges of the matches in document order */
+        query     = null,               /* query the matches were collected for */
+        current   = -1,                 /* index of the selected match */
+        marked    = {},                 /* indices of the highlighted matches */
+        highlight = false,              /* highlight the matches in view */
+        overlay   = null,               /* fixed host of the highlights in the document */
+        layer     = null,               /* box in the overlay moved with the scrolled page */
+        origin    = null,               /* scroll position the layer was created at */
+        stale     = false,              /* the layout changed since the highlighting */
+        timer     = 0,                  /* pending highlighting after scrolling */
+        cId       = "_searchContainer", /* id of the box holding the highlights */
+        mClass    = "_searchMatch",     /* class of the highlight of a match */
+        delay     = 50;                 /* milliseconds to wait after scroll events */
+
+    /* collects the ranges of all matches of q in the text of the document */
+    function collect(q) {
+        var walker, node, text, tag, r, i, len = q.length;
+
+        matches = [];
+        marked  = {};
+        current = -1;
+        query   = q;
+        if (!len || !document.body) {
+            return;
+        }
+        q      = q.toLowerCase();
+        walker = document.createTreeWalker(document.body, NodeFilter.SHOW_TEXT, null, false);
+        while ((node = walker.nextNode())) {
+            tag = node.parentNode.nodeName;
+            if (tag === "SCRIPT" || tag === "STYLE" || tag === "NOSCRIPT") {
+                continue;
+            }
+            text = node.data.toLowerCase();
+            i    = text.indexOf(q);
+            /* text of hidden elements can't be shown as match */
+            if (i < 0 || !node.parentNode.getClientRects().length) {
+                continue;
+            }
+            for (; i >= 0; i = text.indexOf(q, i + len)) {
+                r = document.createRange();
+                r.setStart(node, i);
+                r.setEnd(node, i + len);
+                matches.push(r);
+            }
+        }
+    }
+
+    /* retrieves the index of the first match that does not start before */
+    /* the range r */
+    function indexOf(r) {
+        var lo = 0, hi = matches.length, mid;
+        while (lo < hi) {
+            mid = (lo + hi) >> 1;
+            if (matches[mid].compareBoundaryPoints(Range.START_TO_START, r) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /* retrieves the index of the first match that is not above the */
+    /* viewport - the document order is mostly the order on the screen */
+    function firstInView() {
+        var lo = 0, hi = matches.length, mid;
+        while (lo < hi) {
+            mid = (lo + hi) >> 1;
+            if (matches[mid].getBoundingClientRect().bottom < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /* determines the match to start a new search with - this is the match */
+    /* at the selection or the first one in view */
+    function start(forward) {
+        var sel = window.getSelection(), n = matches.length, i;
+
+        if (!sel || !sel.rangeCount) {
+            i = firstInView();
+            return forward ? i % n : (i + n - 1) % n;
+        }
+        i = indexOf(sel.getRangeAt(0));
+        if (forward) {
+            return i % n;
+        }
+        /* keep the selected match also for backward search */
+        if (i < n && !matches[i].compareBoundaryPoints(Range.START_TO_START, sel.getRangeAt(0))) {
+            return i;
+        }
+        return (i + n - 1) % n;
+    }
+
+    /* selects the match with index i and scrolls it into view */
+    function select(i) {
+        var r = matches[i], sel = window.getSelection(), e, rect;
+
+        current = i;
+        sel.removeAllRanges();
+        sel.addRange(r);
+
+        /* scroll the boxes the match is in, like those with overflow:auto */
+        e = r.startContainer.parentNode;
+        if (e.scrollIntoViewIfNeeded) {
+            e.scrollIntoViewIfNeeded(true);
+        } else {
+            rect = r.getBoundingClientRect();
+            if (rect.top < 0 || rect.bottom > window.innerHeight) {
+                e.scrollIntoView(false);
+            }
+        }
+
+        /* the parent element could be larger than the viewport */
+        rect = r.getBoundingClientRect();
+        if (rect.top < 0 || rect.bottom > window.innerHeight) {
+            window.scrollBy(0, rect.top - window.innerHeight / 2);
+        }
+        if (rect.left < 0 || rect.right > window.innerWidth) {
+            window.scrollBy(rect.left - window.innerWidth / 2, 0);
+        }
+        mark();
+    }
+
+    /* highlights the matches in the viewport - the others are highlighted */
+    /* when they are scrolled into view */
+    function mark() {
+        var h = window.innerHeight, sx, sy, rects, box, i, j;
+
+        if (!highlight || !matches.length) {
+            return;
+        }
+        if (!layer) {
+            createLayer();
+        }
+        /* the boxes are placed relative to the scroll position the layer */
+        /* was created at */
+        sx = window.scrollX - origin.x;
+        sy = window.scrollY - origin.y;
+        for (i = firstInView(); i < matches.length; i++) {
+            rects = matches[i].getClientRects();
+            if (!rects.length) {
+                continue;
+            }
+            if (rects[0].top > h) {
+                break;
+            }
+            if (marked[i]) {
+                continue;
+            }
+            marked[i] = true;
+            for (j = 0; j < rects.length; j++) {
+                box = document.createElement("div");
+                box.className = mClass;
+                box.style.left   = (rects[j].left + sx) + "px";
+                box.style.top    = (rects[j].top + sy) + "px";
+                box.style.width  = rects[j].width + "px";
+                box.style.height = rects[j].height + "px";
+                layer.appendChild(box);
+            }
+        }
+    }
+
+    /* creates the fixed overlay holding the highlights - they are isolated */
+    /* in a shadow root if this is supported, so that neither the page */
+    /* styles apply to them nor the page needs a new layout for them */
+    function createLayer() {
+        var host = document.createElement("div"), style = document.createElement("style"), root;
+
+        host.id            = cId;
+        host.style.cssText = "position:fixed;left:0;top:0;width:0;height:0;" +
+            "overflow:visible;z-index:2147483647;pointer-events:none";
+
+        if (host.attachShadow) {
+            root = host.attachShadow({mode: "closed"});
+        } else if (host.createShadowRoot) {
+            root = host.createShadowRoot();
+        } else if (host.webkitCreateShadowRoot) {
+            root = host.webkitCreateShadowRoot();
+        } else {
+            root = host;
+        }
+        style.textContent = "." + mClass + "{" +
+            "position:absolute;" +
+            "margin:0;" +
+            "padding:0;" +
+            "pointer-events:none;" +
+            "background-color:rgba(255,255,0,0.4)" +
+            "}";
+        root.appendChild(style);
+
+        layer = document.createElement("div");
+        layer.style.position = "absolute";
+        root.appendChild(layer);
+
+        overlay = host;
+        origin  = {x: window.scrollX, y: window.scrollY};
+        stale   = false;
+        document.documentElement.appendChild(host);
+        /* the scroll events of boxes with overflow are caught too */
+        window.addEventListener("scroll", scrolled, true);
+        window.addEventListener("resize", resized, false);
+    }
+
+    /* moves the highlights along with the scrolled page instead of placing */
+    /* them into the document - if only a box of the page was scrolled, the */
+    /* highlights within it are placed new */
+    function scrolled(ev) {
+        if (ev.target === document || ev.target === window) {
+            layer.style.webkitTransform = layer.style.transform =
+                "translate(" + (origin.x - window.scrollX) + "px," + (origin.y - window.scrollY) + "px)";
+        } else {
+            stale = true;
+        }
+        schedule();
+    }
+
+    /* the highlights don't fit the matches after the page got a new layout */
+    function resized() {
+        stale = true;
+        schedule();
+    }
+
+    /* highlights the matches in view after a short delay */
+    function schedule() {
+        if (!timer) {
+            timer = window.setTimeout(function() {
+                timer = 0;
+                if (stale) {
+                    clear();
+                }
+                mark();
+            }, delay);
+        }
+    }
+
+    /* removes the highlights but keeps the matches */
+    function clear() {
+        if (overlay) {
+            window.removeEventListener("scroll", scrolled, true);
+            window.removeEventListener("resize", resized, false);
+            if (overlay.parentNode) {
+                overlay.parentNode.removeChild(overlay);
+            }
+            overlay = layer = origin = null;
+        }
+        stale = false;
+        if (timer) {
+            window.clearTimeout(timer);
+            timer = 0;
+        }
+        marked = {};
+    }
+
+    /* selects the match count matches away from the match the search */
+    /* starts with */
+    function jump(count, forward) {
+        var n = matches.length, i;
+        if (!n) {
+            return;
+        }
+        if (current < 0) {
+            i     = start(forward);
+            count = forward ? count - 1 : count + 1;
+        } else {
+            i = current;
+        }
+        select(((i + count) % n + n) % n);
+    }
+
+    /* retrieves the counter of the matches like 3/12 */
+    function status() {
+        return (current + 1) + "/" + matches.length;
+    }
+
+    /* the api */
+    return {
+        /* starts a new search for q and selects the count match in the */
+        /* search direction */
+        create: function create(q, count, hl) {
+            clear();
+            highlight = hl;
+            collect(q);
+            jump(count, count > 0);
+            return status();
+        },
+        /* moves count matches forward or backward if count is negative - */
+        /* the matches are collected again if the document changed */
+        next: function next(q, count, hl) {
+            highlight = hl;
+            if (q !== query || (matches[current] && matches[current].collapsed)) {
+                clear();
+                collect(q);
+            }
+            jump(count, count > 0);
+            return status();
+        },
+        clear: function() {
+            clear();
+            return "";
+        }
+    };
+})();
@@ -18,22 +18,62 @@
  */
 
 #include "config.h"
+#include <sys/stat.h>
+#include <unistd.h>
 #include "setting.h"
 #include "util.h"
 #include "completion.h"
+#include "ex.h"
+
+#define CACHE_MAGIC "vbc2"
+
+/* record types of the compiled config cache */
+enum {
+    CACHE_SETTING = 's', /* setting with already converted value */
+    CACHE_COMMAND = 'c'  /* any other ex command run as is */
+};
+
+typedef struct {
+    char    magic[4];
+    guint32 settings;   /* number of known settings */
+    guint32 seed;       /* identifies the compiled in default config */
+    guint32 layout;     /* identifies the version and the compiled in settings */
+    gint64  mtime;      /* modification time of the config file */
+    gint64  size;       /* size of the config file */
+    gint64  inode;
+} CacheHeader;
 
 static GHashTable *settings;
 
+/* records applied settings and commands during startup to write them into
+ * the compiled config cache */
+static struct {
+    GByteArray *data;
+} cache;
+
+/* collects the changes of webkit settings to apply them to the view in a
+ * single update */
+static struct {
+    int               level;    /* nesting level of open transactions */
+    WebKitWebSettings *pending; /* copy of the views settings with changes */
+} transaction;
+
 extern VbCore vb;
 
 static Arg *char_to_arg(const char *str, const Type type);
+static gboolean cache_header(const char *config, guint seed, CacheHeader *header);
+static guint32 cache_layout(void);
+static void cache_append_setting(const Setting *s, const Arg *arg);
+static gboolean cache_apply(char *data, const char *end, gboolean apply);
 static void print_value(const Setting *s, void *value);
+static WebKitWebSettings *get_web_settings(gboolean write);
 static gboolean webkit(const Setting *s, const SettingType type);
 #ifdef FEATURE_COOKIE
 static gboolean cookie_accept(const Setting *s, const SettingType type);
 static gboolean cookie_timeout(const Setting *s, const SettingType type);
 #endif
 static gboolean scrollstep(const Setting *s, const SettingType type);
+static gboolean smooth_scroll(const Setting *s, const SettingType type);
 static gboolean status_color_bg(const Setting *s, const SettingType type);
 static gboolean status_color_fg(const Setting *s, const SettingType type);
 static gboolean status_font(const Setting *s, const SettingType type);
@@ -91,6 +131,7 @@ static Setting default_settings[] = {
     {NULL, "strict-focus", TYPE_BOOLEAN, strict_focus, {0}},
 
     {NULL, "scrollstep", TYPE_INTEGER, scrollstep, {0}},
+    {NULL, "smooth-scroll", TYPE_BOOLEAN, smooth_scroll, {0}},
     {NULL, "status-color-bg", TYPE_COLOR, status_color_bg, {0}},
     {NULL, "status-color-fg", TYPE_COLOR, status_color_fg, {0}},
     {NULL, "status-font", TYPE_FONT, status_font, {0}},
@@ -177,6 +218,9 @@ gboolean setting_run(char *name, const char *param)
 
         s->arg = *a;
         result = s->func(s, get);
+        if (result) {
+            cache_append_setting(s, a);
+        }
         if (a->s) {
             g_free(a->s);
         }
@@ -206,13 +250,154 @@ gboolean setting_run(char *name, const char *param)
     }
 
     result = s->func(s, type);
-    if (!result) {
+    if (result) {
+        /* the toggled value depends on the settings applied before, so the
+         * toggle is recorded as command instead of the resulting value */
+        char *cmd = g_strdup_printf("set %s!", name);
+        setting_cache_add_command(setting_cache_mark(), cmd, strlen(cmd));
+        g_free(cmd);
+    } else {
         vb_echo(VB_MSG_ERROR, true, "Could not toggle %s", s->alias ? s->alias : s->name);
     }
 
     return result;
 }
 
+/**
+ * Starts a settings transaction. Until the matching
+ * setting_transaction_commit() all changes of webkit settings are collected
+ * and applied to the view at once. Transactions may be nested.
+ */
+void setting_transaction_begin(void)
+{
+    transaction.level++;
+}
+
+/**
+ * Closes a settings transaction and applies the collected webkit settings if
+ * this was the outermost one.
+ */
+void setting_transaction_commit(void)
+{
+    if (transaction.level <= 0 || --transaction.level > 0) {
+        return;
+    }
+    if (transaction.pending) {
+        webkit_web_view_set_settings(vb.gui.webview, transaction.pending);
+        g_object_unref(transaction.pending);
+        transaction.pending = NULL;
+    }
+}
+
+/**
+ * Starts the recording of the applied settings and commands that are written
+ * as compiled config cache by setting_cache_stop().
+ */
+void setting_cache_start(void)
+{
+    if (!cache.data) {
+        cache.data = g_byte_array_new();
+    }
+}
+
+/**
+ * Stops the config recording. If save is set, the recorded data are written
+ * into the cache file together with the stat data of the config file to
+ * detect if the cache is outdated.
+ */
+void setting_cache_stop(const char *file, const char *config, guint seed, gboolean save)
+{
+    CacheHeader header;
+
+    if (!cache.data) {
+        return;
+    }
+    if (save && file && cache_header(config, seed, &header)) {
+        g_byte_array_prepend(cache.data, (guint8*)&header, sizeof(CacheHeader));
+        if (!g_file_set_contents(file, (char*)cache.data->data, cache.data->len, NULL)) {
+            PRINT_DEBUG("Could not write config cache %s", file);
+        }
+    }
+    g_byte_array_free(cache.data, true);
+    cache.data = NULL;
+}
+
+/**
+ * Returns the current position of the config recording. Used to drop the
+ * records of settings that are run by other commands.
+ */
+guint setting_cache_mark(void)
+{
+    return cache.data ? cache.data->len : 0;
+}
+
+/**
+ * Records given ex command to be run as is if the config is applied from the
+ * cache. Everything recorded since mark was taken is dropped, because it's
+ * done by the command itself.
+ */
+void setting_cache_add_command(guint mark, const char *cmd, int len)
+{
+    guint32 n;
+    const guint8 type = CACHE_COMMAND;
+
+    if (!cache.data) {
+        return;
+    }
+    g_byte_array_set_size(cache.data, mark);
+
+    /* strip the separator to the next command if there is one */
+    if (len > 0 && strchr("|\n", cmd[len - 1]) && (len == 1 || cmd[len - 2] != '\\')) {
+        len--;
+    }
+    if (len <= 0) {
+        return;
+    }
+
+    n = len;
+    g_byte_array_append(cache.data, &type, 1);
+    g_byte_array_append(cache.data, (guint8*)&n, sizeof(n));
+    g_byte_array_append(cache.data, (guint8*)cmd, n);
+    g_byte_array_append(cache.data, (guint8*)"", 1);
+}
+
+/**
+ * Applies the compiled config from given cache file if it's up to date with
+ * the config file. Returns false if the cache could not be used and the
+ * config must be read from the config file.
+ */
+gboolean setting_cache_load(const char *file, const char *config, guint seed)
+{
+    char *data;
+    gsize len;
+    CacheHeader header;
+
+    if (!file || !cache_header(config, seed, &header)
+        || !g_file_get_contents(file, &data, &len, NULL)
+    ) {
+        return false;
+    }
+
+    if (len < sizeof(CacheHeader) || memcmp(data, &header, sizeof(CacheHeader))) {
+        g_free(data);
+        return false;
+    }
+
+    /* check the whole cache before anything is applied, so that a corrupted
+     * cache does not leave a partial applied config */
+    if (!cache_apply(data + sizeof(CacheHeader), data + len, false)) {
+        fprintf(stderr, "Corrupted config cache: %s\n", file);
+        g_free(data);
+        /* remove the cache to get it rebuild from the config file */
+        unlink(file);
+        return false;
+    }
+    cache_apply(data + sizeof(CacheHeader), data + len, true);
+    g_free(data);
+
+    return true;
+}
+
 gboolean setting_fill_completion(GtkListStore *store, const char *input)
 {
     gboolean found = false;
@@ -276,6 +461,138 @@ static Arg *char_to_arg(const char *str, const Type type)
     return arg;
 }
 
+/**
+ * Fills the header of the config cache with the data used to detect if the
+ * cache is still valid for the config file.
+ */
+static gboolean cache_header(const char *config, guint seed, CacheHeader *header)
+{
+    struct stat st;
+
+    memset(header, 0, sizeof(CacheHeader));
+    if (!config || stat(config, &st) != 0) {
+        return false;
+    }
+    memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+    header->settings = LENGTH(default_settings);
+    header->seed     = seed;
+    header->layout   = cache_layout();
+    header->mtime    = st.st_mtime;
+    header->size     = st.st_size;
+    header->inode    = st.st_ino;
+
+    return true;
+}
+
+/**
+ * Retrieves a hash of the version and the names and types of the settings.
+ * The cache refers to the settings by their index, which differs between
+ * builds with other features or webkit versions.
+ */
+static guint32 cache_layout(void)
+{
+    guint32 hash = g_str_hash(VERSION);
+
+    for (guint i = 0; i < LENGTH(default_settings); i++) {
+        hash = hash * 31 + g_str_hash(default_settings[i].name);
+        hash = hash * 31 + default_settings[i].type;
+    }
+
+    return hash;
+}
+
+/**
+ * Records the converted value of a successful set setting.
+ */
+static void cache_append_setting(const Setting *s, const Arg *arg)
+{
+    guint16 idx;
+    gint32 i;
+    guint32 n;
+    const guint8 type = CACHE_SETTING;
+
+    if (!cache.data) {
+        return;
+    }
+
+    idx = s - default_settings;
+    i   = arg->i;
+    n   = arg->s ? strlen(arg->s) : G_MAXUINT32;
+    g_byte_array_append(cache.data, &type, 1);
+    g_byte_array_append(cache.data, (guint8*)&idx, sizeof(idx));
+    g_byte_array_append(cache.data, (guint8*)&i, sizeof(i));
+    g_byte_array_append(cache.data, (guint8*)&n, sizeof(n));
+    if (arg->s) {
+        g_byte_array_append(cache.data, (guint8*)arg->s, n + 1);
+    }
+}
+
+/**
+ * Walks through the records of the config cache between data and end. If
+ * apply is set, the settings are applied and the commands are run.
+ *
+ * Returns false if the records are corrupted.
+ */
+static gboolean cache_apply(char *data, const char *end, gboolean apply)
+{
+    char *p;
+    guint16 idx;
+    gint32 i;
+    guint32 n;
+    gboolean str;
+    Setting *s;
+
+    for (p = data; p < end;) {
+        if (*p == CACHE_SETTING && p + 1 + sizeof(idx) + sizeof(i) + sizeof(n) <= end) {
+            p++;
+            memcpy(&idx, p, sizeof(idx));
+            p += sizeof(idx);
+            memcpy(&i, p, sizeof(i));
+            p += sizeof(i);
+            memcpy(&n, p, sizeof(n));
+            p += sizeof(n);
+            if (idx >= LENGTH(default_settings)
+                || (n != G_MAXUINT32 && (n >= (guint32)(end - p) || p[n] != '\0'))
+            ) {
+                return false;
+            }
+            /* only the settings of string types have a string value */
+            s   = &default_settings[idx];
+            str = s->type == TYPE_CHAR || s->type == TYPE_COLOR || s->type == TYPE_FONT;
+            if (str != (n != G_MAXUINT32)) {
+                return false;
+            }
+
+            if (apply) {
+                /* apply the stored value directly without lookup and
+                 * conversion */
+                s->arg.i = i;
+                s->arg.s = n != G_MAXUINT32 ? p : NULL;
+                s->func(s, SETTING_SET);
+                s->arg.s = NULL;
+            }
+            if (n != G_MAXUINT32) {
+                p += n + 1;
+            }
+        } else if (*p == CACHE_COMMAND && p + 1 + sizeof(n) <= end) {
+            p++;
+            memcpy(&n, p, sizeof(n));
+            p += sizeof(n);
+            if (n >= (guint32)(end - p) || p[n] != '\0') {
+                return false;
+            }
+            if (apply) {
+                ex_run_string(p);
+            }
+            p += n + 1;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * Print the setting value to the input box.
  */
@@ -315,9 +632,27 @@ static void print_value(const Setting *s, void *value)
     }
 }
 
+/**
+ * Returns the webkit settings to read or change. Within a transaction the
+ * changes are made on a copy that is applied to the view on commit.
+ */
+static WebKitWebSettings *get_web_settings(gboolean write)
+{
+    if (transaction.pending) {
+        return transaction.pending;
+    }
+    if (write && transaction.level > 0) {
+        transaction.pending = webkit_web_settings_copy(
+            webkit_web_view_get_settings(vb.gui.webview)
+        );
+        return transaction.pending;
+    }
+    return webkit_web_view_get_settings(vb.gui.webview);
+}
+
 static gboolean webkit(const Setting *s, const SettingType type)
 {
-    WebKitWebSettings *web_setting = webkit_web_view_get_settings(vb.gui.webview);
+    WebKitWebSettings *web_setting = get_web_settings(type != SETTING_GET);
 
     switch (s->type) {
         case TYPE_BOOLEAN:
@@ -434,6 +769,20 @@ static gboolean scrollstep(const Setting *s, const SettingType type)
     return true;
 }
 
+static gboolean smooth_scroll(const Setting *s, const SettingType type)
+{
+    if (type != SETTING_SET) {
+        if (type == SETTING_TOGGLE) {
+            vb.config.smooth_scroll = !vb.config.smooth_scroll;
+        }
+        print_value(s, &vb.config.smooth_scroll);
+    } else {
+        vb.config.smooth_scroll = s->arg.i ? true : false;
+    }
+
+    return true;
+}
+
 static gboolean status_color_bg(const Setting *s, const SettingType type)
 {
     StatusType stype;
@@ -711,7 +1060,7 @@ static gboolean user_style(const Setting *s, const SettingType type)
 {
     gboolean enabled = false;
     char *uri = NULL;
-    WebKitWebSettings *web_setting = webkit_web_view_get_settings(vb.gui.webview);
+    WebKitWebSettings *web_setting = get_web_settings(type != SETTING_GET);
     if (type != SETTING_SET) {
         g_object_get(web_setting, "user-stylesheet-uri", &uri, NULL);
         enabled = (uri != NULL);
@@ -42,6 +42,13 @@ struct _Setting {
 void setting_init(void);
 void setting_cleanup(void);
 gboolean setting_run(char* name, const char* param);
+void setting_transaction_begin(void);
+void setting_transaction_commit(void);
+void setting_cache_start(void);
+void setting_cache_stop(const char *file, const char *config, guint seed, gboolean save);
+guint setting_cache_mark(void);
+void setting_cache_add_command(guint mark, const char *cmd, int len);
+gboolean setting_cache_load(const char *file, const char *config, guint seed);
 gboolean setting_fill_completion(GtkListStore *store, const char *input);
 
 #endif /* end of include guard: _SETTING_H */